@@ -0,0 +1,302 @@
+#include <QCoreApplication>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include "irc.h"
+#include "globals.h"
+
+// Microbenchmarks for the paths every line of chat goes through. Pass a capture
+// (raw IRC lines, one per line, as the server sent them) to measure real traffic,
+// or run without one to use synthetic tag-heavy PRIVMSGs.
+
+const qsizetype BENCHMARK_SYNTHETIC_LINES=100000;
+const qsizetype BENCHMARK_CHUNK=16*1024; //! roughly what a busy socket hands over per read
+const int BENCHMARK_ROUNDS=5;
+
+volatile qsizetype sink=0; //! results go here so the compiler can't throw the work away
+
+namespace Benchmark
+{
+	QTextStream& Out()
+	{
+		static QTextStream out(stdout);
+		return out;
+	}
+
+	QByteArray Synthesize()
+	{
+		static const std::array<const char*,4> BADGES={"subscriber/12,premium/1","moderator/1,subscriber/3012","vip/1,bits/1000","broadcaster/1,subscriber/0"};
+		static const std::array<const char*,4> EMOTES={"25:0-4,12-16/1902:6-10","","305954156:0-7","25:0-4/1902:6-10/88:12-19"};
+		static const std::array<const char*,4> TEXT={"Kappa Keepo Kappa hello there","nice one chat","PogChamp what a play","Kappa Keepo PogChamp tell me about the song"};
+
+		QByteArray capture;
+		capture.reserve(BENCHMARK_SYNTHETIC_LINES*400);
+		for (qsizetype index=0; index < BENCHMARK_SYNTHETIC_LINES; index++)
+		{
+			const std::size_t variant=index%BADGES.size();
+			capture.append(QString("@badge-info=subscriber/14;badges=%1;client-nonce=4f2b7e0c9d1a8e6f3b5c7d9e1f2a4b6c;color=#1E90FF;display-name=Viewer%2;emotes=%3;first-msg=0;flags=;id=b34ccfc7-4977-403a-8a94-%4;mod=0;returning-chatter=0;room-id=1337;subscriber=1;tmi-sent-ts=1507246572675;turbo=0;user-id=%5;user-type= :viewer%2!viewer%2@viewer%2.tmi.twitch.tv PRIVMSG #channel :%6\r\n")
+				.arg(BADGES[variant],QString::number(index%5000),EMOTES[variant],QString::number(index).rightJustified(12,'0'),QString::number(100000+index%5000),TEXT[variant]).toUtf8());
+		}
+		return capture;
+	}
+
+	QByteArray Capture(const QStringList &arguments)
+	{
+		if (arguments.size() < 2) return Synthesize();
+		QFile file(arguments.at(1));
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			Out() << "Failed to open " << file.fileName() << ", using synthetic traffic instead\n";
+			return Synthesize();
+		}
+		QByteArray capture=file.readAll();
+		if (!capture.endsWith('\n')) capture.append("\r\n");
+		return capture;
+	}
+
+	// best of several rounds, since the first one also pays for warming up caches and the allocator
+	void Measure(const QString &name,qsizetype lines,std::function<void()> run)
+	{
+		qint64 best=std::numeric_limits<qint64>::max();
+		for (int round=0; round < BENCHMARK_ROUNDS; round++)
+		{
+			QElapsedTimer timer;
+			timer.start();
+			run();
+			best=std::min(best,timer.nsecsElapsed());
+		}
+		Out() << qSetFieldWidth(48) << Qt::left << name << qSetFieldWidth(0) << QString::number(static_cast<double>(lines)*1e9/std::max<qint64>(best,1),'f',0) << " lines/s\n";
+		Out().flush();
+	}
+
+	// feed the capture through a buffer a chunk at a time, like a socket would
+	template<typename F> void Stream(const QByteArray &capture,F &&consume)
+	{
+		QBuffer device;
+		for (qsizetype position=0; position < capture.size(); position+=BENCHMARK_CHUNK)
+		{
+			device.close();
+			device.setData(capture.sliced(position,std::min(BENCHMARK_CHUNK,capture.size()-position)));
+			device.open(QIODevice::ReadOnly);
+			consume(device);
+		}
+	}
+
+	void Framing(const QByteArray &capture,qsizetype lines)
+	{
+		Out() << "\nFraming (user-001)\n";
+
+		// what Channel::DataAvailable used to do: one getChar() per byte into a shared cache
+		Measure("byte at a time",lines,[&capture]() {
+			QByteArray cache;
+			qsizetype framed=0;
+			Stream(capture,[&cache,&framed](QBuffer &device) {
+				char character='\0';
+				while (device.getChar(&character))
+				{
+					cache.append(character);
+					if (character != '\n') continue;
+					IRC::Message message(QByteArrayView(cache).chopped(2));
+					framed+=message.Valid();
+					cache.clear();
+				}
+			});
+			sink=framed;
+		});
+
+		Measure("IRC::Framer",lines,[&capture]() {
+			IRC::Framer framer;
+			qsizetype framed=0;
+			Stream(capture,[&framer,&framed](QBuffer &device) {
+				framer.Fill(device);
+				while (std::optional<QByteArrayView> line=framer.Line())
+				{
+					IRC::Message message(*line);
+					framed+=message.Valid();
+				}
+			});
+			sink=framed;
+		});
+	}
+
+	// same keywords as the command dispatch in channel.cpp
+	constexpr Keyword::Table<int,11> COMMANDS({
+		{"CAP",0},
+		{"JOIN",1},
+		{"PART",2},
+		{"CLEARMSG",3},
+		{"CLEARCHAT",4},
+		{"PRIVMSG",5},
+		{"NOTICE",6},
+		{"USERNOTICE",7},
+		{"USERSTATE",8},
+		{"PING",9},
+		{"PONG",10}
+	});
+
+	void Keywords(const QByteArray &capture)
+	{
+		Out() << "\nCommand lookup (user-003)\n";
+
+		// the framer's views don't outlive its next Fill(), so take views straight into the capture instead
+		std::vector<QByteArrayView> commands;
+		for (qsizetype start=0, end=capture.indexOf('\n'); end >= 0; start=end+1, end=capture.indexOf('\n',start))
+		{
+			IRC::Message message(QByteArrayView(capture).sliced(start,end-start).chopped(end > start && capture.at(end-1) == '\r' ? 1 : 0));
+			if (message.Valid()) commands.push_back(message.Command());
+		}
+
+		// what the dispatch tables used to be
+		const std::unordered_map<QString,int> map={
+			{"CAP",0},
+			{"JOIN",1},
+			{"PART",2},
+			{"CLEARMSG",3},
+			{"CLEARCHAT",4},
+			{"PRIVMSG",5},
+			{"NOTICE",6},
+			{"USERNOTICE",7},
+			{"USERSTATE",8},
+			{"PING",9},
+			{"PONG",10}
+		};
+		Measure("std::unordered_map<QString>",static_cast<qsizetype>(commands.size()),[&commands,&map]() {
+			int found=0;
+			for (QByteArrayView command : commands)
+			{
+				auto candidate=map.find(QString::fromUtf8(command));
+				if (candidate != map.end()) found+=candidate->second;
+			}
+			sink=found;
+		});
+
+		Measure("Keyword::Table",static_cast<qsizetype>(commands.size()),[&commands]() {
+			int found=0;
+			for (QByteArrayView command : commands)
+			{
+				if (std::optional<int> candidate=COMMANDS.Find(command)) found+=*candidate;
+			}
+			sink=found;
+		});
+	}
+
+	void Tags(const QByteArray &capture)
+	{
+		Out() << "\nTag, badge, and emote decoding (user-019)\n";
+
+		std::vector<IRC::Message> messages;
+		for (qsizetype start=0, end=capture.indexOf('\n'); end >= 0; start=end+1, end=capture.indexOf('\n',start))
+		{
+			IRC::Message message(QByteArrayView(capture).sliced(start,end-start).chopped(end > start && capture.at(end-1) == '\r' ? 1 : 0));
+			if (message.Valid() && message.Command() == QByteArrayView("PRIVMSG")) messages.push_back(message);
+		}
+
+		// enough of a badge table to find what real chat uses
+		static const std::array<const char*,10> SETS={"subscriber","premium","moderator","vip","bits","broadcaster","turbo","partner","glhf-pledge","sub-gifter"};
+		std::unordered_map<QString,std::unordered_map<QString,QString>> nested;
+		std::vector<std::pair<QByteArray,QString>> flat;
+		for (const char *set : SETS)
+		{
+			for (int version=0; version < 100; version++)
+			{
+				const QString url=QString("https://static-cdn.jtvnw.net/badges/v1/%1-%2/1").arg(set,QString::number(version));
+				nested[set][QString::number(version)]=url;
+				flat.push_back({QString("%1/%2").arg(set,QString::number(version)).toUtf8(),url});
+			}
+		}
+		nested["subscriber"]["3012"]=nested["subscriber"]["12"];
+		flat.push_back({"subscriber/3012",nested["subscriber"]["12"]});
+		nested["bits"]["1000"]=nested["bits"]["10"];
+		flat.push_back({"bits/1000",nested["bits"]["10"]});
+		std::sort(flat.begin(),flat.end());
+
+		// what Bot::ParseChatMessage used to do: one scan of the tags for every tag,
+		// a QString for every badge name and version, and toInt() on every range bound
+		Measure("Message::Tag() and QString lookups",static_cast<qsizetype>(messages.size()),[&messages,&nested]() {
+			qsizetype found=0;
+			for (const IRC::Message &message : messages)
+			{
+				found+=message.Tag("display-name").has_value()+message.Tag("color").has_value()+message.Tag("id").has_value()+message.Tag("user-id").has_value();
+				if (std::optional<QByteArrayView> tagBadges=message.Tag("badges"); tagBadges)
+				{
+					QByteArrayView versions=*tagBadges;
+					while (!versions.isEmpty())
+					{
+						std::optional<QByteArrayView> pair=ByteArrayView::Take(versions,',');
+						if (!pair) continue;
+						std::optional<QByteArrayView> name=ByteArrayView::Take(*pair,'/');
+						std::optional<QByteArrayView> version=ByteArrayView::Last(*pair,'/');
+						if (!name || !version) continue;
+						auto set=nested.find(QString::fromLatin1(*name));
+						if (set == nested.end()) continue;
+						found+=set->second.contains(QString::fromLatin1(*version));
+					}
+				}
+				if (std::optional<QByteArrayView> tagEmotes=message.Tag("emotes"); tagEmotes)
+				{
+					QByteArrayView entries=*tagEmotes;
+					while (!entries.isEmpty())
+					{
+						std::optional<QByteArrayView> entry=ByteArrayView::Take(entries,'/');
+						if (!entry) continue;
+						std::optional<QByteArrayView> id=ByteArrayView::Take(*entry,':');
+						if (!id) continue;
+						const QString emoteID=QString::fromLatin1(*id);
+						while (!entry->isEmpty())
+						{
+							std::optional<QByteArrayView> occurrence=ByteArrayView::Take(*entry,',');
+							if (!occurrence) continue;
+							std::optional<QByteArrayView> left=ByteArrayView::First(*occurrence,'-');
+							std::optional<QByteArrayView> right=ByteArrayView::Last(*occurrence,'-');
+							if (!left || !right) continue;
+							found+=left->toInt()+right->toInt()+emoteID.size();
+						}
+					}
+				}
+			}
+			sink=found;
+		});
+
+		Measure("IRC::Tags and a sorted badge table",static_cast<qsizetype>(messages.size()),[&messages,&flat]() {
+			qsizetype found=0;
+			for (const IRC::Message &message : messages)
+			{
+				const IRC::Tags tags(message);
+				found+=tags.Value(IRC::KnownTag::DISPLAY_NAME).has_value()+tags.Value(IRC::KnownTag::COLOR).has_value()+tags.Value(IRC::KnownTag::ID).has_value()+tags.Value(IRC::KnownTag::USER_ID).has_value();
+				if (std::optional<QByteArrayView> tagBadges=tags.Value(IRC::KnownTag::BADGES); tagBadges)
+				{
+					IRC::Badges(*tagBadges,[&flat,&found](const IRC::Badge &badge) {
+						auto candidate=std::lower_bound(flat.begin(),flat.end(),badge.key,[](const std::pair<QByteArray,QString> &entry,QByteArrayView key) {
+							return QByteArrayView(entry.first) < key;
+						});
+						found+=candidate != flat.end() && QByteArrayView(candidate->first) == badge.key;
+					});
+				}
+				if (std::optional<QByteArrayView> tagEmotes=tags.Value(IRC::KnownTag::EMOTES); tagEmotes)
+				{
+					for (const IRC::EmoteRange &range : IRC::Emotes(*tagEmotes)) found+=range.start+range.end+range.id.size();
+				}
+			}
+			sink=found;
+		});
+	}
+}
+
+int main(int argc,char *argv[])
+{
+	QCoreApplication application(argc,argv);
+	const QByteArray capture=Benchmark::Capture(application.arguments());
+	const qsizetype lines=capture.count('\n');
+	Benchmark::Out() << lines << " lines, " << capture.size()/1024 << " KB\n";
+
+	Benchmark::Framing(capture,lines);
+	Benchmark::Keywords(capture);
+	Benchmark::Tags(capture);
+	return 0;
+}
@@ -1,8 +1,12 @@
 #include <QFile>
+#include <QSaveFile>
+#include <QStringDecoder>
+#include <QSet>
 
 #include <QApplication>
 #include <QTimeZone>
 #include <QNetworkReply>
+#include <algorithm>
 #include <ranges>
 #include "bot.h"
 #include "globals.h"
@@ -10,13 +14,14 @@
 #include "twitch.h"
 
 const char *COMMANDS_LIST_FILENAME="commands.json";
-const char *COMMAND_TYPE_NATIVE="native";
-const char *COMMAND_TYPE_AUDIO="announce";
-const char *COMMAND_TYPE_VIDEO="video";
-const char *COMMAND_TYPE_PULSAR="pulsar";
+const std::chrono::milliseconds COMMANDS_RELOAD_DELAY(250);
+const std::chrono::milliseconds ASSET_RETRY_DELAY(60000);
+constexpr const char *COMMAND_TYPE_NATIVE="native";
+constexpr const char *COMMAND_TYPE_AUDIO="announce";
+constexpr const char *COMMAND_TYPE_VIDEO="video";
+constexpr const char *COMMAND_TYPE_PULSAR="pulsar";
 const char COMMAND_PREFIX='!';
 const char *VIEWER_ATTRIBUTES_FILENAME="viewers.json";
-const char *VIEWER_ATTRIBUTES_ERROR="Failed to add viewer to list of viewers";
 const char *VIBE_PLAYLIST_FILENAME="songs.json";
 const char *QUERY_PARAMETER_BROADCASTER_ID="broadcaster_id";
 const char *QUERY_PARAMETER_MODERATOR_ID="moderator_id";
@@ -31,6 +36,11 @@ const char *JSON_KEY_COMMAND_PATH="path";
 const char *JSON_KEY_COMMAND_MESSAGE="message";
 const char *JSON_KEY_COMMAND_REDEMPTION="redemption";
 const char *JSON_KEY_COMMAND_VIEWERS="viewers";
+const char *JSON_KEY_COMMAND_COOLDOWN="cooldown";
+const char *JSON_KEY_COOLDOWN_COMMAND="command";
+const char *JSON_KEY_COOLDOWN_VIEWER="viewer";
+const char *JSON_KEY_COOLDOWN_USES="uses";
+const char *JSON_KEY_COOLDOWN_SECONDS="seconds";
 const char *JSON_KEY_COMMANDS="commands";
 const char *JSON_KEY_WELCOME="welcomed";
 const char *JSON_KEY_BOT="bot";
@@ -46,19 +56,16 @@ const char *TWITCH_API_OPERATION_EMOTE_ONLY="emote only";
 const char *TWITCH_API_OPERATION_STREAM_TITLE="stream title";
 const char *TWITCH_API_OPERATION_STREAM_CATEGORY="stream category";
 const char *TWITCH_API_OPERATION_LOAD_BADGES="badges";
+const char *TWITCH_API_OPERATION_LOAD_EMOTES="emotes";
 const char *TWITCH_API_OPERATION_SHOUTOUT="shoutout";
 const char *TWITCH_API_ERROR_TEMPLATE_INCOMPLETE="Response from requesting %1 was incomplete";
 const char *TWITCH_API_ERROR_TEMPLATE_UNKNOWN="Something went wrong obtaining %1";
 const char *TWITCH_API_ERROR_TEMPLATE_JSON_PARSE="Error parsing %1 JSON: %2";
 const char *TWITCH_API_ERROR_AUTH="Auth token or client ID missing or invalid";
-const char16_t *CHAT_BADGE_BROADCASTER=u"broadcaster";
-const char16_t *CHAT_BADGE_MODERATOR=u"moderator";
-const char16_t *CHAT_TAG_DISPLAY_NAME=u"display-name";
-const char16_t *CHAT_TAG_BADGES=u"badges";
-const char16_t *CHAT_TAG_COLOR=u"color";
-const char16_t *CHAT_TAG_EMOTES=u"emotes";
-const char16_t *CHAT_TAG_MESSAGE_ID=u"id";
-const char16_t *CHAT_TAG_USER_ID=u"user-id";
+const char *CHAT_BADGE_BROADCASTER="broadcaster";
+const char *CHAT_BADGE_MODERATOR="moderator";
+const unsigned int PREFETCH_CONCURRENCY=2;
+const std::size_t PREFETCH_STAGED_LIMIT=256;
 const char *FILE_OPERATION_CREATE="create";
 const char *FILE_OPERATION_OPEN="open";
 const char *FILE_OPERATION_PARSE="parse";
@@ -66,23 +73,25 @@ const char *FILE_OPERATION_WRITE="write";
 const char *FILE_ERROR_TEMPLATE_COMMANDS_LIST="Failed to %1 command list file: %2";
 const char *FILE_ERROR_TEMPLATE_VIBE_PLAYLIST="Failed to %1 vibe playlist list file: %2";
 
-const Bot::CommandTypeLookup Bot::COMMAND_TYPE_LOOKUP={
+constexpr Keyword::Table<CommandType,4> COMMAND_TYPE_LOOKUP({
 	{COMMAND_TYPE_NATIVE,CommandType::NATIVE},
 	{COMMAND_TYPE_VIDEO,CommandType::VIDEO},
 	{COMMAND_TYPE_AUDIO,CommandType::AUDIO},
 	{COMMAND_TYPE_PULSAR,CommandType::PULSAR}
-};
+});
 
-using StringViewLookup=std::unordered_map<QStringView,QStringView>;
-using StringViewTakeResult=std::optional<QStringView>;
+using ByteArrayViewTakeResult=std::optional<QByteArrayView>;
 
-Bot::BadgeIconURLsLookup Bot::badgeIconURLs;
+Bot::BadgeIcons Bot::badgeIcons;
 std::chrono::milliseconds Bot::launchTimestamp=TimeConvert::Now();
 
 Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObject(parent),
 	vibeKeeper(musicPlayer),
 	roaster(false,100,this),
 	security(security),
+	viewerCache(security),
+	prefetching(0),
+	cacheEvictions(0),
 	settingInactivityCooldown(SETTINGS_CATEGORY_EVENTS,"InactivityCooldown",1800000),
 	settingHelpCooldown(SETTINGS_CATEGORY_EVENTS,"HelpCooldown",300000),
 	settingTextWallThreshold(SETTINGS_CATEGORY_EVENTS,"TextWallThreshold",400),
@@ -96,6 +105,8 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	settingRaidInterruptDuration(SETTINGS_CATEGORY_EVENTS,"RaidInterruptDelay",60000),
 	settingDeniedCommandVideo(SETTINGS_CATEGORY_COMMANDS,"Denied"),
 	settingCommandCooldown(SETTINGS_CATEGORY_COMMANDS,"Cooldown",10), // in minutes
+	settingCommandRateUses(SETTINGS_CATEGORY_COMMANDS,"RateUses",0), // commands from everyone combined, zero for no limit
+	settingCommandRateWindow(SETTINGS_CATEGORY_COMMANDS,"RateWindow",30), // in seconds
 	settingUptimeHistory(SETTINGS_CATEGORY_COMMANDS,"UptimeHistory",0),
 	settingCommandNameAgenda(SETTINGS_CATEGORY_COMMANDS,"Agenda","agenda"),
 	settingCommandNameStreamCategory(SETTINGS_CATEGORY_COMMANDS,"StreamCategory","category"),
@@ -130,15 +141,26 @@ Bot::Bot(Music::Player &musicPlayer,Security &security,QObject *parent) : QObjec
 	DeclareCommand({settingCommandNameTotalTime,"Show how many total hours stream has ever been live",CommandType::NATIVE,false},NativeCommandFlag::TOTAL_TIME);
 	DeclareCommand({settingCommandNameVibe,"Start the playlist of music for the stream",CommandType::NATIVE,true},NativeCommandFlag::VIBE);
 	DeclareCommand({settingCommandNameVibeVolume,"Adjust the volume of the vibe keeper",CommandType::NATIVE,true},NativeCommandFlag::VOLUME);
+	connect(&thirdPartyEmotes,&Emotes::Provider::Print,this,&Bot::Print);
+	AddRoom({}); // named once Serve() knows which room the channel joined
 	LoadViewerAttributes();
 
+	commandsReload.setSingleShot(true);
+	commandsReload.setInterval(COMMANDS_RELOAD_DELAY);
+	connect(&commandsReload,&QTimer::timeout,this,&Bot::ReloadCommands);
+	connect(&commandsWatcher,&QFileSystemWatcher::fileChanged,&commandsReload,QOverload<>::of(&QTimer::start));
+	connect(&commandsWatcher,&QFileSystemWatcher::directoryChanged,this,[this]() {
+		if (const QString path=Filesystem::DataPath().filePath(COMMANDS_LIST_FILENAME); QFile::exists(path) && !commandsWatcher.files().contains(path)) commandsReload.start();
+	});
+
 	if (settingRoasts) LoadRoasts();
-	LoadBadgeIconURLs();
 	StartClocks();
 
 	lastRaid=QDateTime::currentDateTime().addMSecs(static_cast<qint64>(0)-static_cast<qint64>(settingRaidInterruptDuration));
 
 	connect(&vibeKeeper,&Music::Player::Print,this,&Bot::Print);
+	connect(&viewerCache,&Viewer::Cache::Print,this,&Bot::Print);
+	viewerCache.Load();
 }
 
 void Bot::DeclareCommand(const Command &&command,NativeCommandFlag flag)
@@ -156,6 +178,10 @@ QJsonDocument Bot::LoadDynamicCommands()
 	}
 	if (!commandListFile.open(QIODevice::ReadOnly)) throw std::runtime_error(QString{FILE_ERROR_TEMPLATE_COMMANDS_LIST}.arg(FILE_OPERATION_OPEN,commandListFile.fileName()).toStdString());
 
+	// editors tend to save by replacing the file, which drops it from the watcher
+	if (!commandsWatcher.files().contains(commandListFile.fileName())) commandsWatcher.addPath(commandListFile.fileName());
+	if (commandsWatcher.directories().isEmpty()) commandsWatcher.addPath(Filesystem::DataPath().absolutePath());
+
 	QByteArray data=commandListFile.readAll();
 	if (data.isEmpty()) data=JSON_ARRAY_EMPTY;
 	const JSON::ParseResult parsedJSON=JSON::Parse(data);
@@ -165,6 +191,9 @@ QJsonDocument Bot::LoadDynamicCommands()
 
 const Command::Lookup& Bot::DeserializeCommands(const QJsonDocument &json)
 {
+	Command::Lookup entries;
+	Command::Lookup stagedRedemptions;
+	AliasLookup aliases;
 	const QJsonArray objects=json.array();
 	for (const QJsonValue &jsonValue : objects)
 	{
@@ -174,17 +203,17 @@ const Command::Lookup& Bot::DeserializeCommands(const QJsonDocument &json)
 		auto redemptionName=jsonObject.find(JSON_KEY_COMMAND_REDEMPTION);
 		if (redemptionName != jsonObject.end())
 		{
-			StageRedemptionCommand(redemptionName->toString(),jsonObject);
+			StageRedemptionCommand(stagedRedemptions,redemptionName->toString(),jsonObject);
 			continue;
 		}
 
+		// native commands only show up here to carry their aliases, so they won't have a type
 		const QString name=jsonObject.value(JSON_KEY_COMMAND_NAME).toString();
-		if (!commands.contains(name))
+		if (auto jsonFieldType=jsonObject.find(JSON_KEY_COMMAND_TYPE); jsonFieldType != jsonObject.end())
 		{
-			std::optional<CommandType> type=ValidCommandType(jsonObject.value(JSON_KEY_COMMAND_TYPE).toString());
+			std::optional<CommandType> type=ValidCommandType(jsonFieldType->toString());
 			if (!type) continue;
-
-			commands.insert({name,{
+			entries.try_emplace(name,
 				name,
 				jsonObject.value(JSON_KEY_COMMAND_DESCRIPTION).toString(),
 				*type,
@@ -194,37 +223,150 @@ const Command::Lookup& Bot::DeserializeCommands(const QJsonDocument &json)
 				Command::FileListFilters(*type),
 				Container::Resolve(jsonObject,JSON_KEY_COMMAND_MESSAGE,{}).toString(),
 				Container::Resolve(jsonObject,JSON_KEY_COMMAND_VIEWERS,{}).toVariant().toStringList(),
-				Container::Resolve(jsonObject,JSON_KEY_COMMAND_PROTECTED,false).toBool()
-			}});
+				Container::Resolve(jsonObject,JSON_KEY_COMMAND_PROTECTED,false).toBool(),
+				DeserializeCooldown(jsonObject.value(JSON_KEY_COMMAND_COOLDOWN).toObject())
+			);
 		}
 
 		auto jsonObjectAliases=jsonObject.find(JSON_KEY_COMMAND_ALIASES);
 		if (jsonObjectAliases == jsonObject.end()) continue;
-		const QJsonArray aliases=jsonObjectAliases->toArray();
-		for (const QJsonValue &jsonValue : aliases)
+		const QJsonArray names=jsonObjectAliases->toArray();
+		for (const QJsonValue &jsonValue : names) aliases.try_emplace(jsonValue.toString(),name);
+	}
+
+	MergeCommands(redemptions,stagedRedemptions);
+	ApplyCommands(entries,aliases);
+	return commands;
+}
+
+void Bot::ApplyCommands(Command::Lookup &entries,const AliasLookup &aliases)
+{
+	// aliases are just copies that point back at their parent, so it's
+	// cheaper to take them all down and put them back than to diff them
+	for (auto candidate=commands.begin(); candidate != commands.end();)
+	{
+		if (candidate->second.Parent())
 		{
-			const QString alias=jsonValue.toString();
-			const Command &command=commands.at(name);
-			const CommandType type=command.Type();
-			commands.try_emplace(alias,alias,&commands.at(name));
-			if (type == CommandType::NATIVE) nativeCommandFlags.insert({alias,nativeCommandFlags.at(name)});
+			nativeCommandFlags.erase(candidate->first);
+			candidate=commands.erase(candidate);
+			continue;
 		}
+		candidate->second.Disown();
+		++candidate;
 	}
-	return commands;
+
+	const QStringList changed=MergeCommands(commands,entries);
+	for (const std::unique_ptr<Room> &room : rooms)
+	{
+		for (const QString &name : changed) room->cooldowns.Forget(name);
+	}
+
+	for (const auto &[alias,name] : aliases)
+	{
+		auto parent=commands.find(name);
+		if (parent == commands.end() || parent->second.Parent()) continue;
+		if (!commands.try_emplace(alias,alias,&parent->second).second) continue;
+		if (parent->second.Type() == CommandType::NATIVE) nativeCommandFlags.insert({alias,nativeCommandFlags.at(name)});
+	}
+
+	if (!changed.isEmpty()) IndexTriggers();
+}
+
+QStringList Bot::MergeCommands(Command::Lookup &current,Command::Lookup &incoming)
+{
+	// Anything that hasn't changed stays exactly where it is, along with its file
+	// list and wherever it was in its shuffle, so only edited commands are rebuilt.
+	// Native commands are declared in code and never come or go.
+	QStringList changed;
+	for (auto candidate=current.begin(); candidate != current.end();)
+	{
+		if (candidate->second.Type() == CommandType::NATIVE)
+		{
+			++candidate;
+			continue;
+		}
+
+		if (auto replacement=incoming.find(candidate->first); replacement != incoming.end() && candidate->second.Equivalent(replacement->second))
+		{
+			incoming.erase(replacement);
+			++candidate;
+			continue;
+		}
+
+		changed.append(candidate->first);
+		candidate=current.erase(candidate);
+	}
+
+	// whatever is left over is either new or a new version of something we just took out
+	while (!incoming.empty())
+	{
+		auto node=incoming.extract(incoming.begin());
+		if (current.contains(node.key())) continue;
+		node.mapped().Disown();
+		if (!changed.contains(node.key())) changed.append(node.key());
+		current.insert(std::move(node));
+	}
+
+	return changed;
+}
+
+void Bot::ReloadCommands()
+{
+	// if it's gone, it's probably halfway through being replaced, and
+	// the directory watch will bring us back once it reappears
+	if (!QFile::exists(Filesystem::DataPath().filePath(COMMANDS_LIST_FILENAME))) return;
+
+	try
+	{
+		DeserializeCommands(LoadDynamicCommands());
+	}
+
+	catch (const std::runtime_error &exception)
+	{
+		emit Print(exception.what(),"reload commands"); // keep running what we had
+	}
+}
+
+Cooldown::Policy Bot::DeserializeCooldown(const QJsonObject &object)
+{
+	auto limit=[](const QJsonObject &object) -> Cooldown::Limit {
+		return {object.value(JSON_KEY_COOLDOWN_USES).toDouble(),std::chrono::milliseconds(static_cast<qint64>(object.value(JSON_KEY_COOLDOWN_SECONDS).toDouble()*1000))};
+	};
+	return {
+		.command=limit(object.value(JSON_KEY_COOLDOWN_COMMAND).toObject()),
+		.viewer=limit(object.value(JSON_KEY_COOLDOWN_VIEWER).toObject())
+	};
+}
+
+QJsonObject Bot::SerializeCooldown(const Cooldown::Policy &policy)
+{
+	auto limit=[](const Cooldown::Limit &limit) {
+		return QJsonObject{
+			{JSON_KEY_COOLDOWN_USES,limit.uses},
+			{JSON_KEY_COOLDOWN_SECONDS,static_cast<double>(limit.window.count())/1000}
+		};
+	};
+	QJsonObject object;
+	if (policy.command.Enabled()) object.insert(JSON_KEY_COOLDOWN_COMMAND,limit(policy.command));
+	if (policy.viewer.Enabled()) object.insert(JSON_KEY_COOLDOWN_VIEWER,limit(policy.viewer));
+	return object;
 }
 
 QJsonDocument Bot::SerializeCommands(const Command::Lookup &entries)
 {
-	NativeCommandFlagLookup mergedNativeCommandFlags;
 	QJsonArray array;
 	std::unordered_map<QString,QStringList> aliases;
+	AliasLookup parents;
+	Command::Lookup incoming;
 	for (const auto& [name,command] : entries)
 	{
 		if (command.Parent())
 		{
 			aliases[command.Parent()->Name()].push_back(name);
+			parents.try_emplace(name,command.Parent()->Name());
 			continue; // if this is just an alias, move on without processing it as a full command
 		}
+		incoming.try_emplace(name,command);
 
 		QJsonObject object;
 		object.insert(JSON_KEY_COMMAND_NAME,name);
@@ -234,7 +376,6 @@ QJsonDocument Bot::SerializeCommands(const Command::Lookup &entries)
 		case CommandType::BLANK:
 			throw std::logic_error("UI should not allow empty command type");
 		case CommandType::NATIVE:
-			mergedNativeCommandFlags.insert(nativeCommandFlags.extract(name));
 			continue;
 		case CommandType::AUDIO:
 			object.insert(JSON_KEY_COMMAND_TYPE,COMMAND_TYPE_AUDIO);
@@ -248,6 +389,7 @@ QJsonDocument Bot::SerializeCommands(const Command::Lookup &entries)
 			if (!command.Message().isEmpty()) object.insert(JSON_KEY_COMMAND_MESSAGE,command.Message());
 			if (command.Protected()) object.insert(JSON_KEY_COMMAND_PROTECTED,command.Protected());
 			if (!command.Viewers().empty()) object.insert(JSON_KEY_COMMAND_VIEWERS,QJsonArray::fromStringList(command.Viewers()));
+			if (const QJsonObject cooldown=SerializeCooldown(command.Limits()); !cooldown.isEmpty()) object.insert(JSON_KEY_COMMAND_COOLDOWN,cooldown);
 			break;
 		case CommandType::VIDEO:
 			object.insert(JSON_KEY_COMMAND_TYPE,COMMAND_TYPE_VIDEO);
@@ -260,11 +402,13 @@ QJsonDocument Bot::SerializeCommands(const Command::Lookup &entries)
 			}
 			if (command.Protected()) object.insert(JSON_KEY_COMMAND_PROTECTED,command.Protected());
 			if (!command.Viewers().empty()) object.insert(JSON_KEY_COMMAND_VIEWERS,QJsonArray::fromStringList(command.Viewers()));
+			if (const QJsonObject cooldown=SerializeCooldown(command.Limits()); !cooldown.isEmpty()) object.insert(JSON_KEY_COMMAND_COOLDOWN,cooldown);
 			break;
 		case CommandType::PULSAR:
 			object.insert(JSON_KEY_COMMAND_TYPE,COMMAND_TYPE_PULSAR);
 			object.insert(JSON_KEY_COMMAND_DESCRIPTION,command.Description());
 			if (command.Protected()) object.insert(JSON_KEY_COMMAND_PROTECTED,command.Protected());
+			if (const QJsonObject cooldown=SerializeCooldown(command.Limits()); !cooldown.isEmpty()) object.insert(JSON_KEY_COMMAND_COOLDOWN,cooldown);
 			break;
 		}
 
@@ -299,8 +443,7 @@ QJsonDocument Bot::SerializeCommands(const Command::Lookup &entries)
 		}));
 	}
 
-	commands=entries;
-	nativeCommandFlags.swap(mergedNativeCommandFlags);
+	ApplyCommands(incoming,parents);
 
 	return QJsonDocument(array);
 }
@@ -326,12 +469,12 @@ bool Bot::SaveDynamicCommands(const QJsonDocument &json)
 	return result;
 }
 
-void Bot::StageRedemptionCommand(const QString &name,const QJsonObject &jsonObject)
+void Bot::StageRedemptionCommand(Command::Lookup &staged,const QString &name,const QJsonObject &jsonObject)
 {
 	std::optional<CommandType> type=ValidCommandType(jsonObject.value(JSON_KEY_COMMAND_TYPE).toString());
 	if (!type) return;
 
-	redemptions.try_emplace(name,
+	staged.try_emplace(name,
 		name,
 		jsonObject.value(JSON_KEY_COMMAND_DESCRIPTION).toString(),
 		*type,
@@ -345,6 +488,34 @@ void Bot::StageRedemptionCommand(const QString &name,const QJsonObject &jsonObje
 	);
 }
 
+void Bot::IndexTriggers()
+{
+	// Maps each viewer to the commands they help trigger and counts who's already been
+	// welcomed, so an arrival only has to touch the groups that viewer is actually in
+	// (each room welcomes its viewers separately, so each keeps its own count)
+	for (const std::unique_ptr<Room> &room : rooms)
+	{
+		room->triggerGroups.clear();
+		room->triggerIndex.clear();
+		for (const Command &command : commands | std::views::values | std::views::filter([](const Command &command) {
+			return !command.Parent() && !command.Viewers().isEmpty();
+		}))
+		{
+			const std::size_t index=room->triggerGroups.size();
+			TriggerGroup group {.command=command.Name(),.members=0,.welcomed=0};
+			QSet<QString> members;
+			for (const QString &name : command.Viewers()) members.insert(name.toLower());
+			for (const QString &member : members)
+			{
+				group.members++;
+				if (std::optional<Viewer::ID> viewer=Known(*room,member); viewer && room->viewers.Test(*viewer,Viewer::Flag::WELCOMED)) group.welcomed++;
+				room->triggerIndex[member].push_back(index);
+			}
+			room->triggerGroups.push_back(group);
+		}
+	}
+}
+
 const Command::Lookup& Bot::Commands() const
 {
 	return commands;
@@ -352,7 +523,13 @@ const Command::Lookup& Bot::Commands() const
 
 bool Bot::LoadViewerAttributes() // FIXME: have this throw an exception rather than return a bool
 {
-	QFile viewerAttributesFile(Filesystem::DataPath().filePath(VIEWER_ATTRIBUTES_FILENAME));
+	// viewers are looked up in the database as they show up, so there's nothing to load here
+	// unless this is the first run since viewers.json was the only record we kept
+	Database::Viewers &database=Primary().database;
+	if (!database.Open()) return false;
+	if (!database.Empty()) return true;
+
+	QFile viewerAttributesFile(ViewerAttributesPath());
 	if (!viewerAttributesFile.exists()) return true; // a non-existent attributes file is valid if this is a first run
 
 	if (!viewerAttributesFile.open(QIODevice::ReadOnly))
@@ -375,37 +552,88 @@ bool Bot::LoadViewerAttributes() // FIXME: have this throw an exception rather t
 	for (QJsonObject::const_iterator viewer=entries.begin(); viewer != entries.end(); ++viewer)
 	{
 		const QJsonObject attributes=viewer->toObject();
-		viewers[viewer.key()]={
-			.commands=Container::Resolve(attributes,JSON_KEY_COMMANDS,true).toBool(),
-			.welcomed=Container::Resolve(attributes,JSON_KEY_WELCOME,false).toBool(),
-			.bot=Container::Resolve(attributes,JSON_KEY_BOT,false).toBool(),
-			.limited=Container::Resolve(attributes,JSON_KEY_LIMIT_COMMANDS,false).toBool(),
-			.subscribed=Container::Resolve(attributes,JSON_KEY_SUBSCRIBED,false).toBool(),
-			.commandTimestamp=std::chrono::system_clock::now()-std::chrono::minutes(static_cast<qint64>(settingCommandCooldown))
-		};
+		quint8 flags=0;
+		if (Container::Resolve(attributes,JSON_KEY_COMMANDS,true).toBool()) flags|=static_cast<quint8>(Viewer::Flag::COMMANDS);
+		if (Container::Resolve(attributes,JSON_KEY_WELCOME,false).toBool()) flags|=static_cast<quint8>(Viewer::Flag::WELCOMED);
+		if (Container::Resolve(attributes,JSON_KEY_BOT,false).toBool()) flags|=static_cast<quint8>(Viewer::Flag::BOT);
+		if (Container::Resolve(attributes,JSON_KEY_LIMIT_COMMANDS,false).toBool()) flags|=static_cast<quint8>(Viewer::Flag::LIMITED);
+		if (Container::Resolve(attributes,JSON_KEY_SUBSCRIBED,false).toBool()) flags|=static_cast<quint8>(Viewer::Flag::SUBSCRIBED);
+		database.Flags(viewer.key(),flags);
 	}
+	database.Flush();
+	emit Print(QString("Imported %1 viewers from %2").arg(QString::number(entries.size()),viewerAttributesFile.fileName()));
 
 	return true;
 }
 
 void Bot::SaveViewerAttributes(bool reset)
 {
-	QFile viewerAttributesFile(Filesystem::DataPath().filePath(VIEWER_ATTRIBUTES_FILENAME));
-	if (!viewerAttributesFile.open(QIODevice::WriteOnly)) return; // FIXME: how can we report the error here while closing?
+	// every change is already on its way to the database, this just makes sure it gets there
+	for (const std::unique_ptr<Room> &room : rooms)
+	{
+		if (reset) room->database.Reset(static_cast<quint8>(~(static_cast<quint8>(Viewer::Flag::WELCOMED)|static_cast<quint8>(Viewer::Flag::SUBSCRIBED))));
+		room->database.Flush();
+	}
+}
 
+bool Bot::ExportViewerAttributes(const QString &path)
+{
+	// the same format viewers.json always had, so it can be edited by hand or imported into a fresh database
+	// (that's only ever the channel's own room, which is the one viewers.json was kept for)
 	QJsonObject entries;
-	for (const auto& [name,attributes] : viewers)
-	{
-		entries.insert(name,QJsonObject{
-			{JSON_KEY_COMMANDS,attributes.commands},
-			{JSON_KEY_WELCOME,reset ? false : attributes.welcomed},
-			{JSON_KEY_BOT,attributes.bot},
-			{JSON_KEY_LIMIT_COMMANDS,attributes.limited},
-			{JSON_KEY_SUBSCRIBED,reset ? false : attributes.subscribed}
+	const bool read=Primary().database.Each([&entries](const QString &login,quint8 flags) {
+		entries.insert(login,QJsonObject{
+			{JSON_KEY_COMMANDS,static_cast<bool>(flags&static_cast<quint8>(Viewer::Flag::COMMANDS))},
+			{JSON_KEY_WELCOME,static_cast<bool>(flags&static_cast<quint8>(Viewer::Flag::WELCOMED))},
+			{JSON_KEY_BOT,static_cast<bool>(flags&static_cast<quint8>(Viewer::Flag::BOT))},
+			{JSON_KEY_LIMIT_COMMANDS,static_cast<bool>(flags&static_cast<quint8>(Viewer::Flag::LIMITED))},
+			{JSON_KEY_SUBSCRIBED,static_cast<bool>(flags&static_cast<quint8>(Viewer::Flag::SUBSCRIBED))}
 		});
+	});
+	if (!read) return false;
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		emit Print(QString("Failed to open %1 for exporting viewers: %2").arg(path,file.errorString()));
+		return false;
 	}
+	file.write(QJsonDocument(entries).toJson(QJsonDocument::Indented));
+	if (!file.commit())
+	{
+		emit Print(QString("Failed to export viewers to %1: %2").arg(path,file.errorString()));
+		return false;
+	}
+	emit Print(QString("Exported %1 viewers to %2").arg(QString::number(entries.size()),path));
+	return true;
+}
+
+QString Bot::ViewerAttributesPath()
+{
+	return Filesystem::DataPath().filePath(VIEWER_ATTRIBUTES_FILENAME);
+}
 
-	viewerAttributesFile.write(QJsonDocument(entries).toJson(QJsonDocument::Indented));
+void Bot::RecordViewerAttributes(Room &room,Viewer::ID viewer)
+{
+	room.database.Flags(room.viewers.Login(viewer),room.viewers.Flags(viewer));
+}
+
+std::optional<Viewer::ID> Bot::Known(Room &room,const QString &login)
+{
+	if (std::optional<Viewer::ID> viewer=room.viewers.Find(login); viewer) return viewer;
+
+	// only viewers who show up this session are kept in memory
+	std::optional<quint8> flags=room.database.Flags(login);
+	if (!flags) return std::nullopt;
+	const Viewer::ID viewer=room.viewers.Intern(login);
+	room.viewers.Flags(viewer,*flags);
+	return viewer;
+}
+
+Viewer::ID Bot::Remember(Room &room,const QString &login)
+{
+	if (std::optional<Viewer::ID> viewer=Known(room,login); viewer) return *viewer;
+	return room.viewers.Intern(login);
 }
 
 File::List Bot::DeserializeVibePlaylist(const QJsonDocument &json)
@@ -480,9 +708,21 @@ void Bot::LoadRoasts()
 	roaster.Sources(File::List{static_cast<QString>(settingRoasts),Command::FileListFilters(CommandType::AUDIO)});
 }
 
-void Bot::LoadBadgeIconURLs()
+void Bot::LoadChatImages()
 {
-	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_BADGES)},Network::Method::GET,[this](QNetworkReply *reply) {
+	// The channel's own badges and emotes are what its chat uses most, so they go
+	// out ahead of the global badges, since the queue keeps its order. The images
+	// themselves trail along at low priority, so by the time the first messages
+	// arrive most of them are already sitting in the cache.
+	LoadBadgeIconURLs(Twitch::Endpoint(Twitch::ENDPOINT_CHANNEL_BADGES),{{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()}},true);
+	LoadChannelEmotes();
+	thirdPartyEmotes.Load(security.AdministratorID());
+	LoadBadgeIconURLs(Twitch::Endpoint(Twitch::ENDPOINT_BADGES),{},false);
+}
+
+void Bot::LoadBadgeIconURLs(const QString &endpoint,const QUrlQuery &query,bool channel)
+{
+	Network::Request::Send({endpoint},Network::Method::GET,[this,channel](QNetworkReply *reply) {
 		static const char *JSON_KEY_ID="id";
 		static const char *JSON_KEY_SET_ID="set_id";
 		static const char *JSON_KEY_VERSIONS="versions";
@@ -504,23 +744,66 @@ void Bot::LoadBadgeIconURLs()
 			const QJsonObject objectBadgeSet=set.toObject();
 			auto jsonFieldSetID=objectBadgeSet.find(JSON_KEY_SET_ID);
 			auto jsonFieldVersions=objectBadgeSet.find(JSON_KEY_VERSIONS);
-			if (jsonFieldSetID == objectBadgeSet.end() || jsonFieldVersions == objectBadgeSet.end()) return;
+			if (jsonFieldSetID == objectBadgeSet.end() || jsonFieldVersions == objectBadgeSet.end()) continue;
 			const QJsonArray jsonFieldVersionsArray=jsonFieldVersions->toArray();
 			for (const QJsonValue &version : jsonFieldVersionsArray)
 			{
 				const QJsonObject objectImageVersions=version.toObject();
 				auto jsonFieldID=objectImageVersions.find(JSON_KEY_ID);
 				auto jsonFieldVersionURL=objectImageVersions.find(JSON_KEY_IMAGE_URL);
-				if (jsonFieldID == objectImageVersions.end() || jsonFieldVersionURL == objectImageVersions.end()) return;
-				badgeIconURLs[jsonFieldSetID->toString()][jsonFieldID->toString()]=jsonFieldVersionURL->toString(); // NOTE: I'm not sure how to construct in place here
+				if (jsonFieldID == objectImageVersions.end() || jsonFieldVersionURL == objectImageVersions.end()) continue;
+				const QString url=jsonFieldVersionURL->toString();
+				StoreBadgeIcon({
+					.key=QString("%1/%2").arg(jsonFieldSetID->toString(),jsonFieldID->toString()).toUtf8(),
+					.url=url,
+					.path=Network::Cache::Path(url),
+					.channel=channel
+				});
+				PrefetchAsset(url);
 			}
 		}
-	},{},{
+	},query,{
+		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
+		{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
+	});
+}
+
+void Bot::LoadChannelEmotes()
+{
+	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_CHANNEL_EMOTES)},Network::Method::GET,[this](QNetworkReply *reply) {
+		static const char *JSON_KEY_ID="id";
+
+		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
+		if (!parsedJSON)
+		{
+			emit Print(QString(TWITCH_API_ERROR_TEMPLATE_JSON_PARSE).arg(TWITCH_API_OPERATION_LOAD_EMOTES,parsedJSON.error));
+			return;
+		}
+
+		// chat messages only give us the emote's ID, so build the same URL they will
+		// rather than using the one in the response, or the cache wouldn't recognize it
+		const QJsonArray jsonFieldData=parsedJSON().object().value(JSON::Keys::DATA).toArray();
+		for (const QJsonValue &emote : jsonFieldData)
+		{
+			const QString id=emote.toObject().value(JSON_KEY_ID).toString();
+			if (!id.isEmpty()) PrefetchAsset(Twitch::Content(Twitch::ENDPOINT_EMOTES).arg(id));
+		}
+	},{{QUERY_PARAMETER_BROADCASTER_ID,security.AdministratorID()}},{
 		{NETWORK_HEADER_AUTHORIZATION,security.Bearer(security.OAuthToken())},
 		{NETWORK_HEADER_CLIENT_ID,security.ClientID()}
 	});
 }
 
+void Bot::PrefetchAsset(const QString &url)
+{
+	// only warms the disk cache; decoding waits until a message actually shows the image
+	if (Network::Cache::Contains(url)) return;
+	Network::Cache::Fetch(url,[](const QByteArray &data,const QString &error) {
+		Q_UNUSED(data)
+		Q_UNUSED(error) // a chat message that needs it will try again and report the failure then
+	},Network::Priority::LOW);
+}
+
 void Bot::StartClocks()
 {
 	inactivityClock.setInterval(TimeConvert::Interval(std::chrono::milliseconds(settingInactivityCooldown)));
@@ -552,7 +835,7 @@ void Bot::Redemption(const QString &login,const QString &name,const QString &rew
 	if (auto redemption=redemptions.find(rewardTitle); redemption != redemptions.end())
 	{
 		const Command &command=redemption->second;
-		DispatchCommandViaCommandObject(command,login);
+		DispatchCommandViaCommandObject(Primary(),command,login);
 		return;
 	}
 
@@ -561,22 +844,9 @@ void Bot::Redemption(const QString &login,const QString &name,const QString &rew
 
 void Bot::Subscription(const QString &login,const QString &displayName)
 {
-	std::unordered_map<QString,Viewer::Attributes>::iterator viewer;
-	if (auto candidate=viewers.find(login); candidate != viewers.end())
-	{
-		if (candidate->second.subscribed) return;
-		viewer=candidate;
-	}
-	else
-	{
-		auto inserted=viewers.insert({login,{}});
-		if (!inserted.second)
-		{
-			emit Print(VIEWER_ATTRIBUTES_ERROR,u"announce subscription"_s);
-			return;
-		}
-		viewer=inserted.first;
-	}
+	Room &room=Primary();
+	const Viewer::ID viewer=Remember(room,login);
+	if (room.viewers.Test(viewer,Viewer::Flag::SUBSCRIBED)) return;
 
 	if (static_cast<QString>(settingSubscriptionSound).isEmpty())
 	{
@@ -584,7 +854,8 @@ void Bot::Subscription(const QString &login,const QString &displayName)
 		return;
 	}
 	emit AnnounceSubscription(displayName,settingSubscriptionSound);
-	viewer->second.subscribed=true;
+	room.viewers.Set(viewer,Viewer::Flag::SUBSCRIBED);
+	RecordViewerAttributes(room,viewer);
 }
 
 void Bot::Raid(const QString &viewer,const unsigned int viewers)
@@ -613,179 +884,226 @@ void Bot::RestoreMusic()
 	vibeKeeper.DuckVolume(false);
 }
 
-void Bot::DispatchArrival(const QString &login)
+void Bot::DispatchArrival(Room &room,const QString &login)
 {
-	if (auto viewer=viewers.find(login); viewer != viewers.end())
-	{
-		// if the viewer is a bot or is already welcomed, bail
-		if (viewer->second.bot || viewer->second.welcomed) return;
-	}
-	else
-	{
-		// we've never seen this person before, so add a new object to represent them
-		if (!viewers.insert({login,{}}).second)
-		{
-			emit Print(VIEWER_ATTRIBUTES_ERROR,u"announce arrival"_s);
-			return;
-		}
-	}
+	// if we've never seen this person before, this is where they get an ID
+	// if the viewer is a bot or is already welcomed, bail
+	if (const Viewer::ID known=Remember(room,login); room.viewers.Test(known,Viewer::Flag::BOT) || room.viewers.Test(known,Viewer::Flag::WELCOMED)) return;
 
 	// viewer (whether they've been seen before or not) hasn't been welcomed yet
-	Viewer::Remote *viewer=new Viewer::Remote(security,login);
+	Viewer::Remote *viewer=new Viewer::Remote(viewerCache,login);
 	connect(viewer,&Viewer::Remote::Print,this,&Bot::Print);
-	connect(viewer,&Viewer::Remote::Recognized,viewer,[this](const Viewer::Local &viewer) {
+	connect(viewer,&Viewer::Remote::Recognized,viewer,[this,&room](const Viewer::Local &viewer) {
 		if (security.Administrator() == viewer.Name() || QDateTime::currentDateTime().toMSecsSinceEpoch()-lastRaid.toMSecsSinceEpoch() < static_cast<qint64>(settingRaidInterruptDuration)) return;
-		Viewer::ProfileImage::Remote *profileImage=viewer.ProfileImage();
-		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,viewer](std::shared_ptr<QImage> profileImage) {
-			// Do we have a sound configured to announce them with? If so, fire the signal.
-			if (settingArrivalSound) emit AnnounceArrival(viewer.DisplayName(),profileImage,File::List(settingArrivalSound).Random());
-
-			// Do we have any commands that are triggered by the viewers we've seen?
-			for (const Command &candidateCommand : commands | std::views::values | std::views::filter([](const Command &command) {
-				return !command.Viewers().isEmpty();
-			}))
-			{
-				// look through the list of viewers attached to the command
-				// we're looking for when all of the viewers in the list have been welcomed _except_ the one that just arrived
-				bool triggerViewerIsCandidate=false;
-				if (std::all_of(candidateCommand.Viewers().begin(),candidateCommand.Viewers().end(),[&triggerViewerIsCandidate,&triggerViewer=viewer,this](const QString &name) {
-					auto candidateViewer=viewers.find(name);
-					if (candidateViewer != viewers.end()) // if the name from the command is in the list of names we've seen in the channel
-					{
-						// is this the triggering viewer?
-						if (triggerViewer.Name() == candidateViewer->first)
-						{
-							// if so, we only want to act if they haven't been welcomed yet
-							if (candidateViewer->second.welcomed) return false;
-							triggerViewerIsCandidate=true;
-						}
-						else
-						{
-							// otherwise, we want to make sure this person has been welcomed already
-							if (!candidateViewer->second.welcomed) return false;
-						}
-						return true;
-					}
-					return false;
-				}) && triggerViewerIsCandidate) emit DispatchCommandViaCommandObject(candidateCommand,security.Administrator());
-			}
 
-			// save the viewer object and its attributes, marking it as welcomed
-			viewers.at(viewer.Name()).welcomed=true;
-			SaveViewerAttributes(false);
-			emit Welcomed(viewer.Name());
+		// if the prefetcher already staged their profile image, there's nothing left to wait on
+		if (auto staged=stagedProfileImages.find(viewer.Name()); staged != stagedProfileImages.end())
+		{
+			std::shared_ptr<QImage> profileImage=staged->second;
+			stagedProfileImages.erase(staged);
+			PumpPrefetch(); // made room for another
+			Welcome(room,viewer,profileImage);
+			return;
+		}
+
+		Viewer::ProfileImage::Remote *profileImage=viewer.ProfileImage(this);
+		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,&room,viewer](std::shared_ptr<QImage> profileImage) {
+			Welcome(room,viewer,profileImage);
 		});
 		connect(profileImage,&Viewer::ProfileImage::Remote::Print,this,&Bot::Print);
 	});
 }
 
-void Bot::ParseChatMessage(const QString &prefix,const QString &source,const QStringList &parameters,const QString &message)
+void Bot::Welcome(Room &room,const Viewer::Local &viewer,std::shared_ptr<QImage> profileImage)
 {
-	// As of right now, Twitch doesn't use parameters in front of the chat message
-	// so it's always the final parameter, and the final paramater is always the
-	// only parameter. This may change in the future, so passing it in and marking it
-	// unused to shut the compiler up for now.
-	Q_UNUSED(parameters)
+	// two messages close together can both get this far, but only the first one welcomes them
+	const Viewer::ID welcomed=Remember(room,viewer.Name());
+	if (room.viewers.Test(welcomed,Viewer::Flag::WELCOMED)) return;
 
-	std::optional<QStringView> window;
+	// Do we have a sound configured to announce them with? If so, fire the signal.
+	if (settingArrivalSound) emit AnnounceArrival(viewer.DisplayName(),profileImage,File::List(settingArrivalSound).Random());
 
-	QStringView remainingText(message);
-	QStringView login;
-	Chat::Message chatMessage;
+	// save the viewer's attributes, marking them as welcomed
+	room.viewers.Set(welcomed,Viewer::Flag::WELCOMED);
 
-	// parse tags
-	window=prefix;
-	StringViewLookup tags;
-	while (!window->isEmpty())
+	// Do we have any commands that are triggered by the viewers we've seen?
+	// A command fires when the last of its viewers to show up has been welcomed.
+	if (auto groups=room.triggerIndex.find(viewer.Name()); groups != room.triggerIndex.end())
 	{
-		StringViewTakeResult pair=StringView::Take(*window,';');
-		if (!pair) continue; // skip malformated badges rather than making a visible fuss
-		StringViewTakeResult key=StringView::Take(*pair,'=');
-		if (!key) continue; // same as above
-		StringViewTakeResult value=StringView::Last(*pair,'=');
-		if (!value) continue; // I'll rely on "missing" to represent an empty value
-		tags.try_emplace(*key,*value);
+		for (std::size_t index : groups->second)
+		{
+			TriggerGroup &group=room.triggerGroups[index];
+			if (++group.welcomed == group.members)
+			{
+				if (auto command=commands.find(group.command); command != commands.end()) DispatchCommandViaCommandObject(room,command->second,security.Administrator());
+			}
+		}
 	}
-	if (auto displayName=tags.find(CHAT_TAG_DISPLAY_NAME); displayName != tags.end()) chatMessage.displayName=displayName->second.toString();
-	if (auto tagColor=tags.find(CHAT_TAG_COLOR); tagColor != tags.end()) chatMessage.color=tagColor->second.toString();
-	if (auto messageID=tags.find(CHAT_TAG_MESSAGE_ID); messageID != tags.end())
+
+	RecordViewerAttributes(room,welcomed);
+	emit Welcomed(viewer.Name());
+}
+
+void Bot::Prefetch(const QStringList &logins)
+{
+	// Only worth the bandwidth if there's going to be an announcement to show,
+	// and only for people who haven't been welcomed and aren't bots
+	if (!settingArrivalSound) return;
+	for (const QString &login : logins)
 	{
-		chatMessage.id=messageID->second.toString();
-		if (auto userID=tags.find(CHAT_TAG_USER_ID); userID != tags.end()) userMessageCrossReference[userID->second.toString()].push_back(messageID->second.toString());
+		if (security.Administrator() == login || stagedProfileImages.contains(login)) continue;
+		if (std::optional<Viewer::ID> viewer=Known(Primary(),login); viewer && (Primary().viewers.Test(*viewer,Viewer::Flag::BOT) || Primary().viewers.Test(*viewer,Viewer::Flag::WELCOMED))) continue;
+		prefetchQueue.push_back(login);
 	}
+	PumpPrefetch();
+}
 
-	// badges
-	if (auto tagBadges=tags.find(CHAT_TAG_BADGES); tagBadges != tags.end())
+void Bot::Unstage(const QStringList &logins)
+{
+	// nothing to announce for someone who left before saying anything
+	for (const QString &login : logins)
+	{
+		stagedProfileImages.erase(login);
+		std::erase(prefetchQueue,login);
+	}
+	PumpPrefetch();
+}
+
+void Bot::PumpPrefetch()
+{
+	// Keep this to a trickle so it never gets between chat and a command's network requests
+	while (prefetching < PREFETCH_CONCURRENCY && !prefetchQueue.empty() && stagedProfileImages.size() < PREFETCH_STAGED_LIMIT)
 	{
-		StringViewLookup badges;
-		QStringView &versions=tagBadges->second;
-		while (!versions.isEmpty())
+		const QString login=prefetchQueue.front();
+		prefetchQueue.pop_front();
+		prefetching++;
+
+		Viewer::Remote *viewer=new Viewer::Remote(viewerCache,login,true);
+		connect(viewer,&Viewer::Remote::Unrecognized,this,[this]() {
+			prefetching--;
+			PumpPrefetch();
+		});
+		connect(viewer,&Viewer::Remote::Recognized,this,[this](const Viewer::Local &viewer) {
+			if (std::optional<Viewer::ID> known=Primary().viewers.Find(viewer.Name()); known && Primary().viewers.Test(*known,Viewer::Flag::WELCOMED))
+			{
+				// they spoke before we got to them
+				prefetching--;
+				PumpPrefetch();
+				return;
+			}
+
+			Viewer::ProfileImage::Remote *profileImage=viewer.ProfileImage(this);
+			connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,this,[this,login=viewer.Name()](std::shared_ptr<QImage> profileImage) {
+				stagedProfileImages.insert({login,profileImage});
+			});
+			connect(profileImage,&QObject::destroyed,this,[this]() {
+				// the image deletes itself whether the download worked or not
+				prefetching--;
+				PumpPrefetch();
+			});
+		});
+	}
+}
+
+void Bot::ParseChatMessage(const IRC::Message &message)
+{
+	// Everything up until the chat message is built is a view into the line
+	// the channel received, so nothing is copied until we know what we need.
+	const QString text=QString::fromUtf8(message.Trailing().value_or(QByteArrayView{}));
+	QStringView remainingText(text);
+	std::shared_ptr<Chat::Message> pooledMessage=chatMessages.Acquire();
+	Chat::Message &chatMessage=*pooledMessage;
+
+	// tags
+	const IRC::Tags tags(message);
+	if (ByteArrayViewTakeResult displayName=tags.Value(IRC::KnownTag::DISPLAY_NAME); displayName)
+	{
+		// decode straight into the buffer the recycled message kept, rather than building a new string to replace it
+		QStringDecoder decoder(QStringDecoder::Utf8);
+		chatMessage.displayName.resize(decoder.requiredSpace(displayName->size()));
+		chatMessage.displayName.truncate(decoder.appendToBuffer(chatMessage.displayName.data(),*displayName)-chatMessage.displayName.constData());
+	}
+	if (ByteArrayViewTakeResult tagColor=tags.Value(IRC::KnownTag::COLOR); tagColor && !tagColor->isEmpty()) chatMessage.color=QColor::fromString(QLatin1String(tagColor->data(),tagColor->size()));
+	if (ByteArrayViewTakeResult messageID=tags.Value(IRC::KnownTag::ID); messageID && !messageID->isEmpty())
+	{
+		chatMessage.id.append(QLatin1StringView(messageID->data(),messageID->size()));
+		if (ByteArrayViewTakeResult userID=tags.Value(IRC::KnownTag::USER_ID); userID && !userID->isEmpty())
 		{
-			StringViewTakeResult pair=StringView::Take(versions,',');
-			if (!pair) continue;
-			StringViewTakeResult name=StringView::Take(*pair,'/');
-			if (!name) continue;
-			StringViewTakeResult version=StringView::Last(*pair,'/');
-			if (!version) continue; // a badge must have a version
-			badges.insert({*name,*version});
-			std::optional<QString> badgeIconPath=DownloadBadgeIcon(name->toString(),version->toString());
-			if (!badgeIconPath) continue;
-			chatMessage.badges.append(*badgeIconPath);
+			bool valid=false;
+			if (quint64 id=userID->toULongLong(&valid); valid) chatHistory.Add(chatMessage.id,id,message.Parameter(0).value_or(QByteArrayView{}));
 		}
-		if (auto badgeBroadcaster=badges.find(CHAT_BADGE_BROADCASTER); badgeBroadcaster != badges.end() && badgeBroadcaster->second == u"1") chatMessage.broadcaster=true;
-		if (auto badgeModerator=badges.find(CHAT_BADGE_MODERATOR); badgeModerator != badges.end() && badgeModerator->second == u"1") chatMessage.moderator=true;
+	}
+
+	// badges
+	if (ByteArrayViewTakeResult tagBadges=tags.Value(IRC::KnownTag::BADGES); tagBadges)
+	{
+		chatMessage.badges.reserve(tagBadges->count(',')+1);
+		IRC::Badges(*tagBadges,[this,&chatMessage](const IRC::Badge &badge) {
+			if (badge.version == QByteArrayView("1"))
+			{
+				if (badge.set == QByteArrayView(CHAT_BADGE_BROADCASTER)) chatMessage.broadcaster=true;
+				if (badge.set == QByteArrayView(CHAT_BADGE_MODERATOR)) chatMessage.moderator=true;
+			}
+			if (const BadgeIcon *icon=FindBadgeIcon(badge.key); icon) DownloadBadgeIcon(*icon,chatMessage);
+		});
 	}
 
 	// emotes
-	if (auto tagEmotes=tags.find(CHAT_TAG_EMOTES); tagEmotes != tags.end())
+	// the recycled message still holds the last one's emotes, so write over those slots
+	// and their buffers first, and only drop whatever this message didn't need
+	std::size_t emoteCount=0;
+	if (ByteArrayViewTakeResult tagEmotes=tags.Value(IRC::KnownTag::EMOTES); tagEmotes)
 	{
-		QStringView &entries=tagEmotes->second;
-		while (!entries.isEmpty())
+		const IRC::EmoteRanges ranges=IRC::Emotes(*tagEmotes);
+		chatMessage.emotes.reserve(ranges.Size());
+		for (const IRC::EmoteRange &range : ranges)
 		{
-			StringViewTakeResult entry=StringView::Take(entries,'/');
-			if (!entry) continue;
-			StringViewTakeResult id=StringView::Take(*entry,':');
-			if (!id) continue;
-			while (!entry->isEmpty())
+			if (emoteCount == chatMessage.emotes.size()) chatMessage.emotes.emplace_back();
+			const QLatin1StringView id(range.id.data(),range.id.size());
+			const auto slot=chatMessage.emotes.begin()+emoteCount++;
+			auto previous=std::find_if(chatMessage.emotes.begin(),slot,[&id](const Chat::Emote &emote) {
+				return id == emote.id;
+			});
+			Chat::Emote &emote=*slot;
+			if (previous == slot)
 			{
-				StringViewTakeResult occurrence=StringView::Take(*entry,',');
-				StringViewTakeResult left=StringView::First(*occurrence,'-');
-				StringViewTakeResult right=StringView::Last(*occurrence,'-');
-				if (!left || !right) continue;
-				int start=StringConvert::Integer(left->toString());
-				int end=StringConvert::Integer(right->toString());
-				chatMessage.emotes.emplace_back(Chat::Emote{
-					.id=id->toString(),
-					.start=start,
-					.end=end
-				});
+				emote.id.truncate(0);
+				emote.id.append(id);
 			}
+			else
+			{
+				emote.id=previous->id; // an emote used more than once shares one copy of its ID
+			}
+			emote.name.truncate(0);
+			emote.path.truncate(0);
+			emote.url.truncate(0);
+			emote.start=range.start;
+			emote.end=range.end;
 		}
-		std::sort(chatMessage.emotes.begin(),chatMessage.emotes.end());
 	}
-
-	window=source;
+	chatMessage.emotes.erase(chatMessage.emotes.begin()+emoteCount,chatMessage.emotes.end());
 
 	// hostmask
-	// TODO: break these down in the Channel class, not here
-	StringViewTakeResult hostmask=StringView::Take(*window,' ');
-	if (!hostmask) return;
-	StringViewTakeResult user=StringView::Take(*hostmask,'!');
-	if (!user) return;
-	login=*user;
+	ByteArrayViewTakeResult nick=message.Nick();
+	if (!nick) return;
+	const QString login=QString::fromUtf8(*nick);
+
+	// chat from a room we're sitting in but not serving is shown, but doesn't drive the bot
+	Room *room=Serving(message);
+	if (room) room->database.Seen(login);
 
 	// determine if this is a command, and if so, process it as such
 	// and if it's valid, we're done
-	window=message;
-	std::optional<QString> command=ParseCommandIfExists(*window);
+	QStringView window(text);
+	std::optional<QString> command=room ? ParseCommandIfExists(window) : std::nullopt;
 	if (command)
 	{
-		chatMessage.text=window->toString().trimmed();
-		DispatchCommandViaChatMessage(*command,chatMessage,login.toString());
+		chatMessage.text=window.toString().trimmed();
+		DispatchCommandViaChatMessage(*room,*command,chatMessage,login);
 		return;
 	}
 
-	if (!chatMessage.broadcaster) DispatchArrival(login.toString());
+	if (room && !chatMessage.broadcaster) DispatchArrival(*room,login);
 
 	// determine if the message is an action
 	remainingText=remainingText.trimmed();
@@ -796,124 +1114,181 @@ void Bot::ParseChatMessage(const QString &prefix,const QString &source,const QSt
 	}
 
 	// download emotes (which will set emote names in the process) and check for wall of text
-	int emoteCharacterCount=ParseEmoteNamesAndDownloadImages(chatMessage.emotes,remainingText);
-	if (remainingText.size()-emoteCharacterCount > static_cast<int>(settingTextWallThreshold) && settingTextWallSound) emit AnnounceTextWall(message,settingTextWallSound);
+	thirdPartyEmotes.Match(remainingText,chatMessage.emotes);
+	int emoteCharacterCount=ParseEmoteNamesAndDownloadImages(chatMessage,remainingText);
+	if (room && remainingText.size()-emoteCharacterCount > static_cast<int>(settingTextWallThreshold) && settingTextWallSound) emit AnnounceTextWall(text,settingTextWallSound);
 
-	chatMessage.text=remainingText.toString();
-	emit ChatMessage(std::make_shared<Chat::Message>(chatMessage));
-	inactivityClock.start();
+	chatMessage.text.append(remainingText); // appending reuses whatever buffer the pooled message already has
+	emit ChatMessage(pooledMessage);
+	if (room) inactivityClock.start();
 }
 
-void Bot::ParseChatMessageDeletion(const QString &prefix)
+void Bot::Serve(const QStringList &rooms)
 {
-	static const char *OPERATION="delete message";
+	// the first room is the channel's own, which already has its state from the constructor,
+	// while the others each get their own viewers, cooldowns, and database
+	if (rooms.isEmpty()) return;
+	Primary().name=StringConvert::ByteArray(rooms.first());
+	for (const QString &name : rooms.sliced(1))
+	{
+		Room &room=AddRoom(name);
+		if (!room.database.Open()) emit Print(QString("Failed to open viewer database for %1").arg(name));
+	}
+	IndexTriggers();
+}
+
+Bot::Room& Bot::AddRoom(const QString &name)
+{
+	Room &room=*rooms.emplace_back(std::make_unique<Room>(name));
+	connect(&room.database,&Database::Viewers::Print,this,&Bot::Print);
+
+	// these only change by editing the settings file, so read them once rather than on every command
+	room.cooldowns.Limited({1,std::chrono::minutes(static_cast<qint64>(settingCommandCooldown))});
+	room.cooldowns.Global({static_cast<qreal>(settingCommandRateUses),static_cast<std::chrono::seconds>(settingCommandRateWindow)});
 
-	std::optional<QStringView> window;
+	return room;
+}
+
+Bot::Room& Bot::Primary()
+{
+	return *rooms.front();
+}
 
-	window=prefix;
-	StringViewLookup tags;
-	while (!window->isEmpty())
+Bot::Room* Bot::Serving(const IRC::Message &message)
+{
+	// there are only ever a handful of rooms, so a scan beats hashing the name
+	if (Primary().name.isEmpty()) return &Primary();
+	const QByteArrayView target=message.Parameter(0).value_or(QByteArrayView{});
+	for (const std::unique_ptr<Room> &room : rooms)
 	{
-		StringViewTakeResult pair=StringView::Take(*window,';');
-		if (!pair)
-		{
-			emit Print("Can't delete because a tag was missing a body",OPERATION);
-			return;
-		}
-		StringViewTakeResult key=StringView::Take(*pair,'=');
-		if (!key)
-		{
-			emit Print("Can't delete because a tag had no key no key",OPERATION);
-			return;
-		}
-		StringViewTakeResult value=StringView::Last(*pair,'=');
-		if (!value)
-		{
-			emit Print("Can't delete because a key had no value",OPERATION);
-			return;
-		}
-		tags.try_emplace(*key,*value);
+		if (QByteArrayView(room->name) == target) return room.get();
 	}
+	return nullptr;
+}
 
-	// was this a single message?
-	auto candidate=tags.find(u"target-msg-id");
-	if (candidate != tags.end())
+void Bot::ParseChatMessageDeletion(const IRC::Message &message)
+{
+	static const char *OPERATION="delete message";
+
+	if (message.Tags().isEmpty())
 	{
-		emit DeleteChatMessage(candidate->second.toString());
+		emit Print("Can't delete because the message had no tags",OPERATION);
 		return;
 	}
 
-	// was it all of the message from a single user?
-	candidate=tags.find(u"target-user-id");
-	if (candidate != tags.end())
+	// was this a single message?
+	const IRC::Tags tags(message);
+	if (ByteArrayViewTakeResult candidate=tags.Value(IRC::KnownTag::TARGET_MSG_ID); candidate)
 	{
-		auto messages=userMessageCrossReference.find(candidate->second.toString());
-		if (messages == userMessageCrossReference.end()) return;
-		for (const QString &messageID : messages->second) emit DeleteChatMessage(messageID);
-		userMessageCrossReference.erase(messages);
+		emit DeleteChatMessages({QString::fromLatin1(*candidate)});
 		return;
 	}
 
-	// clear the whole room
-	for (const auto &messages : userMessageCrossReference)
+	// was it all of the message from a single user?
+	if (ByteArrayViewTakeResult candidate=tags.Value(IRC::KnownTag::TARGET_USER_ID); candidate)
 	{
-		for (const QString &messageID : messages.second) emit DeleteChatMessage(messageID);
+		bool valid=false;
+		const quint64 id=candidate->toULongLong(&valid);
+		if (!valid) return;
+		if (const QStringList ids=chatHistory.Purge(id,message.Parameter(0).value_or(QByteArrayView{})); !ids.isEmpty()) emit DeleteChatMessages(ids);
+		return;
 	}
-	userMessageCrossReference.clear();
+
+	// clear the whole room, leaving whatever the other rooms said
+	if (const QStringList ids=chatHistory.Clear(message.Parameter(0).value_or(QByteArrayView{})); !ids.isEmpty()) emit DeleteChatMessages(ids);
 }
 
-std::optional<QString> Bot::DownloadBadgeIcon(const QString &badge,const QString &version)
+const Bot::BadgeIcon* Bot::FindBadgeIcon(QByteArrayView key)
 {
-	auto badgeIconVersions=badgeIconURLs.find(badge);
-	if (badgeIconVersions == badgeIconURLs.end()) return std::nullopt;
-	auto badgeIconVersion=badgeIconVersions->second.find(version);
-	if (badgeIconVersion == badgeIconVersions->second.end()) return std::nullopt;
-	const QString badgeIconURL=badgeIconVersion->second;
-	static const QString CHAT_BADGE_ICON_PATH_TEMPLATE=Filesystem::TemporaryPath().filePath(QString("%1_%2.png"));
-	QString badgePath=CHAT_BADGE_ICON_PATH_TEMPLATE.arg(badge,version);
-	if (!QFile(badgePath).exists())
+	auto candidate=std::lower_bound(badgeIcons.begin(),badgeIcons.end(),key,[](const BadgeIcon &icon,QByteArrayView key) {
+		return QByteArrayView(icon.key) < key;
+	});
+	if (candidate == badgeIcons.end() || QByteArrayView(candidate->key) != key) return nullptr;
+	return &*candidate;
+}
+
+void Bot::StoreBadgeIcon(BadgeIcon &&icon)
+{
+	// the channel's versions of a set (subscriber, bits) win over the global ones,
+	// whichever of the two happened to arrive first
+	auto candidate=std::lower_bound(badgeIcons.begin(),badgeIcons.end(),icon,[](const BadgeIcon &left,const BadgeIcon &right) {
+		return left.key < right.key;
+	});
+	if (candidate != badgeIcons.end() && candidate->key == icon.key)
 	{
-		Network::Request::Send(badgeIconURL,Network::Method::GET,[this,badgeIconURL,badgePath](QNetworkReply *downloadReply) {
-			if (downloadReply->error())
-			{
-				emit Print(QString("Failed to download badge %1: %2").arg(badgeIconURL,downloadReply->errorString()));
-				return;
-			}
-			if (!QImage::fromData(downloadReply->readAll()).save(badgePath)) emit Print(QString("Failed to save badge %2").arg(badgePath));
-			emit RefreshChat();
-		});
+		if (candidate->channel && !icon.channel) return;
+		*candidate=std::move(icon);
 	}
-	return badgePath;
+	else
+		badgeIcons.insert(candidate,std::move(icon));
 }
 
-int Bot::ParseEmoteNamesAndDownloadImages(std::vector<Chat::Emote> &emotes,const QStringView &textWindow)
+void Bot::DownloadBadgeIcon(const BadgeIcon &icon,Chat::Message &chatMessage)
+{
+	const Asset asset=DownloadAsset(icon.url,icon.path,"badge",icon.url);
+	if (asset == Asset::FAILED) return;
+	if (asset == Asset::PENDING) chatMessage.pending.append(icon.path);
+	chatMessage.badges.append(icon.path);
+}
+
+int Bot::ParseEmoteNamesAndDownloadImages(Chat::Message &chatMessage,const QStringView &textWindow)
 {
 	int emoteCharacterCount=0;
-	for (Chat::Emote &emote : emotes)
+	for (Chat::Emote &emote : chatMessage.emotes)
 	{
 		const QStringView name=textWindow.mid(emote.start,1+emote.end-emote.start); // end is an index, not a size, so we have to add 1 to get the size
 		emoteCharacterCount+=name.size();
 		emote.name=name.toString();
-		DownloadEmote(emote); // once we know the emote name, we can determine the path, which means we can download it (download will set the path in the struct)
+		if (DownloadEmote(emote) == Asset::PENDING) chatMessage.pending.append(emote.path); // once we know the emote name, we can determine the path, which means we can download it (download will set the path in the struct)
 	}
 	return emoteCharacterCount;
 }
 
-void Bot::DownloadEmote(Chat::Emote &emote)
+Bot::Asset Bot::DownloadEmote(Chat::Emote &emote)
 {
-	emote.path=Filesystem::TemporaryPath().filePath(QString("%1.png").arg(emote.id));
-	if (!QFile(emote.path).exists())
+	const QString url=emote.url.isEmpty() ? Twitch::Content(Twitch::ENDPOINT_EMOTES).arg(emote.id) : emote.url;
+	emote.path=Network::Cache::Path(url);
+	return DownloadAsset(url,emote.path,"emote",emote.name);
+}
+
+Bot::Asset Bot::DownloadAsset(const QString &url,const QString &path,const char *kind,const QString &subject)
+{
+	// the cache has thrown files out since we last looked, so whatever we thought was ready has to be checked again
+	if (const quint64 evictions=Network::Cache::Evictions(); evictions != cacheEvictions)
 	{
-		Network::Request::Send(Twitch::Content(Twitch::ENDPOINT_EMOTES).arg(emote.id),Network::Method::GET,[this,emote](QNetworkReply *downloadReply) {
-			if (downloadReply->error())
-			{
-				emit Print(QString("Failed to download emote %1: %2").arg(emote.name,downloadReply->errorString()));
-				return;
-			}
-			if (!QImage::fromData(downloadReply->readAll()).save(emote.path)) emit Print(QString("Failed to save emote %1 to %2").arg(emote.name,emote.path));
-			emit RefreshChat();
+		std::erase_if(assets,[](const auto &candidate) {
+			return candidate.second == Asset::READY;
 		});
+		cacheEvictions=evictions;
 	}
+
+	// only the first message to use an image ever goes looking for it,
+	// and everyone after that just finds out how it went, or waits along with the first
+	auto [asset,inserted]=assets.try_emplace(path,Asset::PENDING);
+	if (!inserted) return asset->second;
+	if (Network::Cache::Contains(url))
+	{
+		asset->second=Asset::READY;
+		return Asset::READY;
+	}
+
+	Network::Cache::Image(url,this,[this,path,kind,subject](const QImage &image,const QString &error) {
+		if (!error.isEmpty())
+		{
+			assets[path]=Asset::FAILED;
+			emit Print(QString("Failed to download %1 %2: %3").arg(kind,subject,error));
+			emit ChatAssetFailed(path);
+
+			// messages in the meantime go without, then the next one to use it tries again
+			QTimer::singleShot(ASSET_RETRY_DELAY,this,[this,path]() {
+				if (auto asset=assets.find(path); asset != assets.end() && asset->second == Asset::FAILED) assets.erase(asset);
+			});
+			return;
+		}
+		assets[path]=Asset::READY;
+		emit ChatAsset(path,image);
+	});
+	return Asset::PENDING;
 }
 
 std::optional<QString> Bot::ParseCommandIfExists(QStringView &message)
@@ -943,7 +1318,7 @@ void Bot::DispatchCommandViaSubsystem(JSON::SignalPayload *response,const QStrin
 				.displayName=name,
 				.text=window.toString()
 			};
-			DispatchCommandViaChatMessage(*command,message,login);
+			DispatchCommandViaChatMessage(Primary(),*command,message,login);
 			response->context.setValue(message);
 		}
 	}
@@ -951,7 +1326,7 @@ void Bot::DispatchCommandViaSubsystem(JSON::SignalPayload *response,const QStrin
 	response->Dispatch();
 }
 
-bool Bot::DispatchCommandViaChatMessage(const QString &name,Chat::Message chatMessage,const QString &login) // build a command object from a command name and a chat message and forward
+bool Bot::DispatchCommandViaChatMessage(Room &room,const QString &name,Chat::Message chatMessage,const QString &login) // build a command object from a command name and a chat message and forward
 {
 	// FIRST! determine if command exists
 	auto commandCandidate=commands.find(name);
@@ -967,20 +1342,27 @@ bool Bot::DispatchCommandViaChatMessage(const QString &name,Chat::Message chatMe
 			emit Print("Denial video doesn't exist ("+file+")");
 
 		emit Print(QString(R"(The command "!%1" is protected but requester is not authorized")").arg(command.Name()));
+		if (!room.name.isEmpty()) emit Say(QString::fromUtf8(room.name),QString("@%1, !%2 is only for moderators").arg(chatMessage.displayName,command.Name()));
 		return false;
 	}
 
-	// have the viewer's command privileges been limited?
-	if (auto viewerCandidate=viewers.find(login); viewerCandidate != viewers.end())
+	// is the viewer limited, or is the command (or are commands in general) being used too quickly?
+	// mods and the broadcaster are never held back
+	if (!chatMessage.Privileged())
 	{
-		Viewer::Attributes &viewer=viewerCandidate->second;
-		if (viewer.limited && std::chrono::duration_cast<std::chrono::minutes>(std::chrono::system_clock::now()-viewer.commandTimestamp) < std::chrono::minutes(static_cast<qint64>(settingCommandCooldown)) && !chatMessage.Privileged())
+		const Viewer::ID viewer=Remember(room,login);
+		switch (room.cooldowns.Check(command.Parent() ? command.Parent()->Name() : command.Name(),command.Limits(),viewer,room.viewers.Test(viewer,Viewer::Flag::LIMITED)))
 		{
+		case Cooldown::Verdict::ALLOWED:
+			break;
+		case Cooldown::Verdict::LIMITED:
 			emit AnnounceDeniedCommand(File::List(settingDeniedCommandVideo).Random());
 			return false;
+		case Cooldown::Verdict::THROTTLED:
+			return false; // answering spam with a video would only add to it
 		}
-		viewer.commandTimestamp=std::chrono::system_clock::now();
 	}
+	room.database.Command(login);
 
 	// command is reformatting text, so feed the formatted chat message back into the system
 	if (command.Type() == CommandType::NATIVE && nativeCommandFlags.at(command.Name()) == NativeCommandFlag::HTML)
@@ -991,21 +1373,24 @@ bool Bot::DispatchCommandViaChatMessage(const QString &name,Chat::Message chatMe
 			emote.start-=offset;
 			emote.end-=offset;
 		}
-		ParseEmoteNamesAndDownloadImages(chatMessage.emotes,chatMessage.text);
+		thirdPartyEmotes.Match(chatMessage.text,chatMessage.emotes);
+		ParseEmoteNamesAndDownloadImages(chatMessage,chatMessage.text);
 		chatMessage.html=true;
-		emit ChatMessage(std::make_shared<Chat::Message>(chatMessage)); // short circuit by firing off the chat message, but not processing the command any further
+		std::shared_ptr<Chat::Message> pooledMessage=chatMessages.Acquire();
+		*pooledMessage=std::move(chatMessage);
+		emit ChatMessage(pooledMessage); // short circuit by firing off the chat message, but not processing the command any further
 		return true;
 	}
 
-	DispatchCommandViaCommandObject(chatMessage.text.isEmpty() ? command : Command{command,chatMessage.text},login);
+	DispatchCommandViaCommandObject(room,chatMessage.text.isEmpty() ? command : Command{command,chatMessage.text},login);
 	return true;
 }
 
-void Bot::DispatchCommandViaCommandObject(const Command &command,const QString &login)
+void Bot::DispatchCommandViaCommandObject(Room &room,const Command &command,const QString &login)
 {
-	Viewer::Remote *viewer=new Viewer::Remote(security,login);
+	Viewer::Remote *viewer=new Viewer::Remote(viewerCache,login);
 	connect(viewer,&Viewer::Remote::Print,this,&Bot::Print);
-	connect(viewer,&Viewer::Remote::Recognized,viewer,[this,command](const Viewer::Local &viewer) {
+	connect(viewer,&Viewer::Remote::Recognized,viewer,[this,&room,command](const Viewer::Local &viewer) {
 		switch (command.Type())
 		{
 		case CommandType::VIDEO:
@@ -1033,10 +1418,10 @@ void Bot::DispatchCommandViaCommandObject(const Command &command,const QString &
 				ToggleEmoteOnly();
 				break;
 			case NativeCommandFlag::FOLLOWAGE:
-				DispatchFollowage(viewer);
+				DispatchFollowage(room,viewer);
 				break;
 			case NativeCommandFlag::LIMIT:
-				ToggleLimitViewer(command.Message());
+				ToggleLimitViewer(room,command.Message());
 			case NativeCommandFlag::HTML:
 				emit Print("HTML was processed as a command rather than a chat message. This shouldn't happen!");
 				break;
@@ -1047,13 +1432,13 @@ void Bot::DispatchCommandViaCommandObject(const Command &command,const QString &
 				DispatchShoutout(command);
 				break;
 			case NativeCommandFlag::SONG:
-				if (Music::Metadata metadata=vibeKeeper.Metadata(); !metadata.title.isEmpty() && !metadata.artist.isEmpty() && !metadata.cover.isNull())
-				{
+				vibeKeeper.Metadata([this](const Music::Metadata &metadata) {
+					if (metadata.title.isEmpty() || metadata.artist.isEmpty() || metadata.cover.isNull()) return;
 					if (metadata.album.isEmpty())
 						emit ShowCurrentSong(metadata.title,metadata.artist,metadata.cover);
 					else
 						emit ShowCurrentSong(metadata.title,metadata.album,metadata.artist,metadata.cover);
-				}
+				});
 				break;
 			case NativeCommandFlag::TIMEZONE:
 				emit ShowTimezone(QDateTime::currentDateTime().timeZone().displayName(QDateTime::currentDateTime().timeZone().isDaylightTime(QDateTime::currentDateTime()) ? QTimeZone::DaylightTime : QTimeZone::StandardTime,QTimeZone::LongName));
@@ -1101,9 +1486,9 @@ void Bot::DispatchCommandList()
 	emit ShowCommandList(descriptions);
 }
 
-void Bot::DispatchFollowage(const Viewer::Local &viewer)
+void Bot::DispatchFollowage(Room &room,const Viewer::Local &viewer)
 {
-	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_USER_FOLLOWS)},Network::Method::GET,[this,viewer](QNetworkReply *reply) {
+	Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_USER_FOLLOWS)},Network::Method::GET,[this,&room,viewer](QNetworkReply *reply) {
 		const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
 		if (!parsedJSON)
 		{
@@ -1134,6 +1519,7 @@ void Bot::DispatchFollowage(const Viewer::Local &viewer)
 			return;
 		}
 		const QDateTime start=QDateTime::fromString(jsonFieldFollowDate->toString(),Qt::ISODate);
+		room.database.Followed(viewer.Name(),start);
 		std::chrono::milliseconds duration=static_cast<std::chrono::milliseconds>(start.msecsTo(QDateTime::currentDateTimeUtc()));
 		std::chrono::years years=std::chrono::duration_cast<std::chrono::years>(duration);
 		std::chrono::months months=std::chrono::duration_cast<std::chrono::months>(duration-years);
@@ -1168,7 +1554,7 @@ void Bot::DispatchShoutout(Command command)
 
 void Bot::DispatchShoutout(const QString &streamer)
 {
-	Viewer::Remote *profile=new Viewer::Remote(security,streamer);
+	Viewer::Remote *profile=new Viewer::Remote(viewerCache,streamer);
 	connect(profile,&Viewer::Remote::Recognized,profile,[this](const Viewer::Local &profile) {
 		// native Twitch shoutout
 		Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_SHOUTOUTS)},Network::Method::POST,[this,streamerID=profile.ID()](QNetworkReply *reply) {
@@ -1204,7 +1590,7 @@ void Bot::DispatchShoutout(const QString &streamer)
 			{Network::CONTENT_TYPE,Network::CONTENT_TYPE_FORM} // Error code 400 can also be cause by missing content type
 		});
 		// bot shoutout
-		Viewer::ProfileImage::Remote *profileImage=profile.ProfileImage();
+		Viewer::ProfileImage::Remote *profileImage=profile.ProfileImage(this);
 		connect(profileImage,&Viewer::ProfileImage::Remote::Retrieved,profileImage,[this,displayName=profile.DisplayName(),description=profile.Description()](std::shared_ptr<QImage> profileImage) {
 			emit Shoutout(displayName,description,profileImage);
 		},Qt::QueuedConnection);
@@ -1293,25 +1679,26 @@ void Bot::DispatchHelpText()
 	emit ShowCommand(candidate->Name(),candidate->Description());
 }
 
-void Bot::ToggleLimitViewer(const QString &target)
+void Bot::ToggleLimitViewer(Room &room,const QString &target)
 {
 	static const char *OPERATION="LIMIT VIEWER";
-	std::unordered_map<QString,Viewer::Attributes>::iterator candidate=viewers.find(target);
-	if (candidate == viewers.end())
+	std::optional<Viewer::ID> viewer=Known(room,target);
+	if (!viewer)
 	{
 		emit Print("Could not limit unrecognized viewer",OPERATION);
 		return;
 	}
 
-	Viewer::Attributes &attributes=candidate->second;
-	if (attributes.limited)
+	if (room.viewers.Test(*viewer,Viewer::Flag::LIMITED))
 	{
-		attributes.limited=false;
+		room.viewers.Set(*viewer,Viewer::Flag::LIMITED,false);
+		RecordViewerAttributes(room,*viewer);
 		emit Print("Unlimiting viewer's command privileges",OPERATION);
 	}
 	else
 	{
-		attributes.limited=true;
+		room.viewers.Set(*viewer,Viewer::Flag::LIMITED);
+		RecordViewerAttributes(room,*viewer);
 		emit Print("Limiting viewer's command privileges with cooldown",OPERATION);
 	}
 }
@@ -1522,13 +1909,9 @@ void Bot::StreamCategory(const QString &category)
 
 std::optional<CommandType> Bot::ValidCommandType(const QString &type)
 {
-	auto candidate=COMMAND_TYPE_LOOKUP.find(type);
-	if (candidate == COMMAND_TYPE_LOOKUP.end())
-	{
-		emit Print(QString("Command type '%1' doesn't exist").arg(candidate->first));
-		return std::nullopt;
-	}
-	return candidate->second;
+	std::optional<CommandType> candidate=COMMAND_TYPE_LOOKUP.Find(QStringView(type));
+	if (!candidate) emit Print(QString("Command type '%1' doesn't exist").arg(type));
+	return candidate;
 }
 
 ApplicationSetting& Bot::ArrivalSound()
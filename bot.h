@@ -8,10 +8,16 @@
 #include <QMediaPlayer>
 #include <QDateTime>
 #include <QTimer>
+#include <QUrlQuery>
+#include <QFileSystemWatcher>
 #include <unordered_map>
+#include <memory>
 #include "entities.h"
 #include "settings.h"
 #include "security.h"
+#include "irc.h"
+#include "database.h"
+#include "emotes.h"
 
 enum class NativeCommandFlag
 {
@@ -44,6 +50,8 @@ public:
 	void ToggleEmoteOnly();
 	void EmoteOnly(bool enable);
 	void SaveViewerAttributes(bool reset);
+	bool ExportViewerAttributes(const QString &path);
+	static QString ViewerAttributesPath();
 	const Command::Lookup& Commands() const;
 	const Command::Lookup& DeserializeCommands(const QJsonDocument &json);
 	QJsonDocument LoadDynamicCommands();
@@ -59,20 +67,60 @@ public:
 	ApplicationSetting& HelpCooldown();
 	ApplicationSetting& TextWallThreshold();
 	ApplicationSetting& TextWallSound();
+	void Serve(const QStringList &rooms);
 protected:
-	using BadgeIconURLsLookup=std::unordered_map<QString,std::unordered_map<QString,QString>>;
-	using CommandTypeLookup=std::unordered_map<QString,CommandType>;
-	Command::Lookup commands;
+	struct BadgeIcon
+	{
+		QByteArray key; //! set and version joined by a slash, the way they appear in the badges tag
+		QString url;
+		QString path;
+		bool channel; //! from the channel's own sets rather than the global ones
+	};
+	using BadgeIcons=std::vector<BadgeIcon>; //! sorted on key, so badges in chat can be looked up straight from the tag without hashing or copying them
+	using AliasLookup=std::unordered_map<QString,QString>; //! alias to the name of the command it stands in for
+	Command::Lookup commands; //! aliases point into here, which is fine since nodes don't move when the table grows
 	Command::Lookup redemptions;
+	QFileSystemWatcher commandsWatcher;
+	QTimer commandsReload; //! editors save in several steps, so wait for them to settle before reading
 	NativeCommandFlagLookup nativeCommandFlags;
-	std::unordered_map<QString,Viewer::Attributes> viewers;
-	std::unordered_map<QString,std::vector<QString>> userMessageCrossReference;
+	Chat::Pool chatMessages;
+	Chat::History chatHistory; //! who sent the messages still on screen, keyed on Twitch's numeric user ID
 	Music::Player &vibeKeeper;
 	Music::Player roaster;
 	QTimer inactivityClock;
 	QTimer helpClock;
 	QDateTime lastRaid;
 	Security &security;
+	Viewer::Cache viewerCache;
+	std::deque<QString> prefetchQueue; //! logins that joined and might need an arrival announcement
+	unsigned int prefetching;
+	Emotes::Provider thirdPartyEmotes;
+	struct TriggerGroup
+	{
+		QString command;
+		int members;
+		int welcomed; //! how many of the members have been welcomed this session
+	};
+	struct Room
+	{
+		Room(const QString &name) : name(StringConvert::ByteArray(name)), database(name) { }
+		QByteArray name; //! as it appears in the first parameter of a PRIVMSG (empty matches any room)
+		Viewer::Store viewers; //! the viewers we've run into this session, the rest stay in the database
+		Database::Viewers database;
+		Cooldown::Engine cooldowns;
+		std::vector<TriggerGroup> triggerGroups;
+		std::unordered_map<QString,std::vector<std::size_t>> triggerIndex; //! viewer login to the trigger groups they belong to
+	};
+	std::vector<std::unique_ptr<Room>> rooms; //! the first is the channel's own room, which is the one EventSub, redemptions, and prefetching belong to
+	enum class Asset
+	{
+		PENDING,
+		READY,
+		FAILED
+	};
+	std::unordered_map<QString,Asset> assets; //! local path of every emote and badge image we've gone looking for this session
+	quint64 cacheEvictions; //! how many times the cache had thrown files out when we last trusted what assets says is ready
+	std::unordered_map<QString,std::shared_ptr<QImage>> stagedProfileImages; //! profile images fetched ahead of a viewer's first message
 	ApplicationSetting settingInactivityCooldown;
 	ApplicationSetting settingHelpCooldown;
 	ApplicationSetting settingTextWallThreshold;
@@ -86,6 +134,8 @@ protected:
 	ApplicationSetting settingRaidInterruptDuration;
 	ApplicationSetting settingDeniedCommandVideo;
 	ApplicationSetting settingCommandCooldown;
+	ApplicationSetting settingCommandRateUses;
+	ApplicationSetting settingCommandRateWindow;
 	ApplicationSetting settingUptimeHistory;
 	ApplicationSetting settingCommandNameAgenda;
 	ApplicationSetting settingCommandNameStreamCategory;
@@ -103,32 +153,49 @@ protected:
 	ApplicationSetting settingCommandNameTotalTime;
 	ApplicationSetting settingCommandNameVibe;
 	ApplicationSetting settingCommandNameVibeVolume;
-	static BadgeIconURLsLookup badgeIconURLs;
+	static BadgeIcons badgeIcons;
 	static std::chrono::milliseconds launchTimestamp;
-	static const CommandTypeLookup COMMAND_TYPE_LOOKUP;
 	void DeclareCommand(const Command &&command,NativeCommandFlag flag);
-	void StageRedemptionCommand(const QString &name,const QJsonObject &jsonObject);
+	void StageRedemptionCommand(Command::Lookup &staged,const QString &name,const QJsonObject &jsonObject);
+	void ApplyCommands(Command::Lookup &entries,const AliasLookup &aliases);
+	static QStringList MergeCommands(Command::Lookup &current,Command::Lookup &incoming);
+	static Cooldown::Policy DeserializeCooldown(const QJsonObject &object);
+	static QJsonObject SerializeCooldown(const Cooldown::Policy &policy);
 	bool LoadViewerAttributes();
+	void RecordViewerAttributes(Room &room,Viewer::ID viewer);
+	std::optional<Viewer::ID> Known(Room &room,const QString &login);
+	Viewer::ID Remember(Room &room,const QString &login);
 	void LoadRoasts();
-	void LoadBadgeIconURLs();
+	void LoadBadgeIconURLs(const QString &endpoint,const QUrlQuery &query,bool channel);
+	void LoadChannelEmotes();
+	void PrefetchAsset(const QString &url);
 	void StartClocks();
 	std::optional<CommandType> ValidCommandType(const QString &type);
-	int ParseEmoteNamesAndDownloadImages(std::vector<Chat::Emote> &emotes,const QStringView &textWindow);
-	void DownloadEmote(Chat::Emote &emote);
-	std::optional<QString> DownloadBadgeIcon(const QString &badge,const QString &version);
+	Room& AddRoom(const QString &name);
+	Room& Primary();
+	Room* Serving(const IRC::Message &message);
+	void IndexTriggers();
+	void Welcome(Room &room,const Viewer::Local &viewer,std::shared_ptr<QImage> profileImage);
+	void PumpPrefetch();
+	int ParseEmoteNamesAndDownloadImages(Chat::Message &chatMessage,const QStringView &textWindow);
+	Asset DownloadEmote(Chat::Emote &emote);
+	static const BadgeIcon* FindBadgeIcon(QByteArrayView key);
+	static void StoreBadgeIcon(BadgeIcon &&icon);
+	void DownloadBadgeIcon(const BadgeIcon &icon,Chat::Message &chatMessage);
+	Asset DownloadAsset(const QString &url,const QString &path,const char *kind,const QString &subject); //! the description is only put together if the download fails
 	std::optional<QString> ParseCommandIfExists(QStringView &message);
-	bool DispatchCommandViaChatMessage(const QString &name,const Chat::Message chatMessage,const QString &login);
-	void DispatchCommandViaCommandObject(const Command &command,const QString &login);
-	void DispatchArrival(const QString &login);
+	bool DispatchCommandViaChatMessage(Room &room,const QString &name,const Chat::Message chatMessage,const QString &login);
+	void DispatchCommandViaCommandObject(Room &room,const Command &command,const QString &login);
+	void DispatchArrival(Room &room,const QString &login);
 	void DispatchVideo(Command command);
 	void DispatchCommandList();
-	void DispatchFollowage(const Viewer::Local &viewer);
+	void DispatchFollowage(Room &room,const Viewer::Local &viewer);
 	void DispatchPanic(const QString &name);
 	void DispatchShoutout(Command command);
 	void DispatchShoutout(const QString &streamer);
 	void DispatchUptime(bool total);
 	void DispatchHelpText();
-	void ToggleLimitViewer(const QString &target);
+	void ToggleLimitViewer(Room &room,const QString &target);
 	void ToggleVibeKeeper();
 	void AdjustVibeVolume(Command command);
 	void StreamTitle(const QString &title);
@@ -136,8 +203,9 @@ protected:
 signals:
 	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("bot core"));
 	void ChatMessage(std::shared_ptr<Chat::Message> message);
-	void DeleteChatMessage(const QString &id);
-	void RefreshChat();
+	void DeleteChatMessages(const QStringList &ids);
+	void ChatAsset(const QString &path,const QImage &image);
+	void ChatAssetFailed(const QString &path);
 	void AnnounceArrival(const QString &name,std::shared_ptr<QImage> profileImage,const QString &audioPath);
 	void PlayVideo(const QString &path);
 	void PlayAudio(const QString &name,const QString &message,const QString &path);
@@ -161,9 +229,14 @@ signals:
 	void AnnounceTextWall(const QString &message,const QString &audioPath);
 	void AnnounceDeniedCommand(const QString &videoPath);
 	void Welcomed(const QString &user);
+	void Say(const QString &room,const QString &message);
 public slots:
-	void ParseChatMessage(const QString &prefix,const QString &source,const QStringList &parameters,const QString &message);
-	void ParseChatMessageDeletion(const QString &prefix);
+	void ParseChatMessage(const IRC::Message &message);
+	void ParseChatMessageDeletion(const IRC::Message &message);
+	void Prefetch(const QStringList &logins);
+	void Unstage(const QStringList &logins);
+	void LoadChatImages();
+	void ReloadCommands();
 	void DispatchCommandViaSubsystem(JSON::SignalPayload *response,const QString &name,const QString &login);
 	void Ping();
 	void Subscription(const QString &login,const QString &displayName);
@@ -1,4 +1,6 @@
 #include <QCoreApplication>
+#include <QHostInfo>
+#include <charconv>
 #include "channel.h"
 #include "globals.h"
 
@@ -9,12 +11,33 @@ const char *OPERATION_SEND="sending data";
 const char *OPERATION_RECEIVE="receiving data";
 const char *OPERATION_CAPABILITIES="recognize capabilities";
 const char *OPERATION_NOTICES="recognize notice";
+const char *OPERATION_OUTBOUND="outbound queue";
 
 const char *TWITCH_HOST="irc.chat.twitch.tv";
 const unsigned int TWITCH_PORT=6667;
 
 const char *IRC_COMMAND_USER="NICK";
-const char *IRC_COMMAND_JOIN="JOIN";
+constexpr const char *IRC_COMMAND_JOIN="JOIN";
+const char *IRC_COMMAND_PRIVMSG="PRIVMSG";
+const char *IRC_WHISPER_PREFIX="/w ";
+
+// https://dev.twitch.tv/docs/irc/#rate-limits
+// the server counts lines when they arrive rather than when we sent them, so give
+// every window a little slack to absorb one batch taking longer to get there than the next
+const std::chrono::milliseconds RATE_LIMIT_SLACK(1000);
+const std::size_t RATE_LIMIT_CHAT=20;
+const std::size_t RATE_LIMIT_CHAT_MODERATOR=100;
+const std::chrono::milliseconds RATE_LIMIT_CHAT_WINDOW=std::chrono::seconds(30)+RATE_LIMIT_SLACK;
+const std::size_t RATE_LIMIT_JOIN=20;
+const std::chrono::milliseconds RATE_LIMIT_JOIN_WINDOW=std::chrono::seconds(10)+RATE_LIMIT_SLACK;
+const std::size_t RATE_LIMIT_WHISPER=100;
+const std::chrono::milliseconds RATE_LIMIT_WHISPER_WINDOW=std::chrono::seconds(60)+RATE_LIMIT_SLACK;
+const std::size_t OUTBOUND_QUEUE_LIMIT=100;
+const qsizetype ROOMS_PER_CONNECTION=50;
+const qsizetype ROOMS_PER_JOIN=10;
+const std::chrono::milliseconds RECONNECT_BACKOFF_INITIAL=std::chrono::seconds(1);
+const std::chrono::milliseconds RECONNECT_BACKOFF_MAXIMUM=std::chrono::seconds(60);
+const std::chrono::milliseconds LIVENESS_INTERVAL=std::chrono::seconds(60);
 
 const char *SETTINGS_CATEGORY_CHANNEL="Channel";
 
@@ -38,10 +61,12 @@ enum class IRCCommand
 	PRIVMSG,
 	NOTICE,
 	USERNOTICE,
-	PING
+	USERSTATE,
+	PING,
+	PONG
 };
 
-const std::unordered_map<QString,IRCCommand> nonNumericIRCCommands={
+constexpr Keyword::Table<IRCCommand,11> nonNumericIRCCommands({
 	{"CAP",IRCCommand::CAP},
 	{IRC_COMMAND_JOIN,IRCCommand::JOIN},
 	{"PART",IRCCommand::PART},
@@ -50,8 +75,10 @@ const std::unordered_map<QString,IRCCommand> nonNumericIRCCommands={
 	{"PRIVMSG",IRCCommand::PRIVMSG},
 	{"NOTICE",IRCCommand::NOTICE},
 	{"USERNOTICE",IRCCommand::USERNOTICE},
-	{"PING",IRCCommand::PING}
-};
+	{"USERSTATE",IRCCommand::USERSTATE},
+	{"PING",IRCCommand::PING},
+	{"PONG",IRCCommand::PONG}
+});
 
 enum class CapabilitiesSubcommand
 {
@@ -59,10 +86,10 @@ enum class CapabilitiesSubcommand
 	NAK
 };
 
-const std::unordered_map<QString,CapabilitiesSubcommand> capabilitiesSubcommands={
+constexpr Keyword::Table<CapabilitiesSubcommand,2> capabilitiesSubcommands({
 	{"ACK",CapabilitiesSubcommand::ACK},
 	{"NAK",CapabilitiesSubcommand::NAK}
-};
+});
 
 enum class Notice
 {
@@ -70,95 +97,117 @@ enum class Notice
 	DENIED,
 };
 
-const std::unordered_map<QString,Notice> notices={
+constexpr Keyword::Table<Notice,2> notices({
 	{"Login authentication failed",Notice::DENIED},
 	{"Improperly formatted auth",Notice::MALFORMATTED_AUTH}
-};
+});
 
-Channel::Channel(Security &security,IRCSocket *socket,QObject *parent) : QObject(parent),
+Channel::Channel(Security &security,QObject *parent) : QObject(parent),
 	security(security),
 	settingChannel(SETTINGS_CATEGORY_CHANNEL,"Name",security.Administrator().Value()),
 	settingProtect(SETTINGS_CATEGORY_CHANNEL,"Protect",false),
-	ircSocket(socket)
+	settingRooms(SETTINGS_CATEGORY_CHANNEL,"Rooms",QString()),
+	settingHost(SETTINGS_CATEGORY_CHANNEL,"Host",TWITCH_HOST),
+	settingPort(SETTINGS_CATEGORY_CHANNEL,"Port",TWITCH_PORT),
+	ircSocket(new IRCSocket()),
+	socketState(QAbstractSocket::UnconnectedState),
+	chatRooms(std::make_shared<ChatRooms>()),
+	reconnect(false),
+	backoff(RECONNECT_BACKOFF_INITIAL)
 {
-	if (!ircSocket) ircSocket=new IRCSocket(this);
+	Outbound(Traffic::JOIN).limit=std::make_shared<RateLimit::SlidingWindow>(RATE_LIMIT_JOIN,RATE_LIMIT_JOIN_WINDOW);
+	Outbound(Traffic::WHISPER).limit=std::make_shared<RateLimit::SlidingWindow>(RATE_LIMIT_WHISPER,RATE_LIMIT_WHISPER_WINDOW);
+	Outbound(Traffic::CHAT).limit=std::make_shared<RateLimit::SlidingWindow>(RATE_LIMIT_CHAT_MODERATOR,RATE_LIMIT_CHAT_WINDOW); // the most we can send across every room together, each room has its own limit below that
+	outboundTimer.setSingleShot(true);
+	connect(&outboundTimer,&QTimer::timeout,this,&Channel::Flush);
+
+	reconnectTimer.setSingleShot(true);
+	connect(&reconnectTimer,&QTimer::timeout,this,&Channel::Connect);
+	rosterTimer.setSingleShot(true);
+	connect(&rosterTimer,&QTimer::timeout,this,&Channel::FlushRoster);
+	livenessTimer.setInterval(LIVENESS_INTERVAL);
+	connect(&livenessTimer,&QTimer::timeout,this,&Channel::CheckLiveness);
+
+	ircSocket->moveToThread(&ioThread);
+	connect(&ioThread,&QThread::finished,ircSocket,&QObject::deleteLater);
 	connect(ircSocket,&IRCSocket::connected,this,[this]() {
 		emit Print("Connected!",OPERATION_CONNECTION);
+		lastReceived.start();
+		livenessTimer.start();
 		Authenticate();
 	});
 	connect(ircSocket,&IRCSocket::disconnected,this,[this]() {
+		// anything left in the control lane belongs to the old session (PONGs, credentials),
+		// and the handshake queues every room again, so stale JOINs would only join them twice
+		Outbound(Traffic::CONTROL).lines={};
+		Outbound(Traffic::JOIN).lines={};
+		livenessTimer.stop();
 		emit Disconnected();
 		emit Print("Disconnected",OPERATION_CONNECTION);
 	});
-	connect(ircSocket,&IRCSocket::readyRead,this,&Channel::DataAvailable);
+	connect(ircSocket,&IRCSocket::stateChanged,this,[this](QAbstractSocket::SocketState state) {
+		socketState=state;
+		// a failed connection attempt never emits disconnected(), so watch the state instead
+		if (state == QAbstractSocket::UnconnectedState && reconnect) ScheduleReconnect();
+	});
+	connect(ircSocket,&IRCSocket::MessagesAvailable,this,&Channel::Drain);
 	connect(ircSocket,&IRCSocket::errorOccurred,this,&Channel::SocketError);
+	connect(ircSocket,&IRCSocket::Print,this,&Channel::Print);
 	connect(this,&Channel::Ping,this,&Channel::Pong);
+	connect(this,&Channel::Denied,this,[this]() {
+		reconnect=false; // retrying with credentials that were just rejected will only get us rate-limited
+	});
+	ioThread.start();
 }
 
 Channel::~Channel()
 {
-	Disconnect();
+	reconnect=false;
+	reconnectTimer.stop();
+	// the socket has to be closed from its own thread, and before that thread goes away
+	QMetaObject::invokeMethod(ircSocket,&IRCSocket::disconnectFromHost,Qt::BlockingQueuedConnection);
+	ioThread.quit();
+	ioThread.wait();
 }
 
-void Channel::DataAvailable()
+void Channel::Drain()
 {
-	static QByteArray cache;
-
-	while (!ircSocket->atEnd())
-	{
-		std::optional<char> character='\0';
-		while (character && *character != '\n')
-		{
-			character=ircSocket->Pop();
-			if (character) cache.append(*character);
-		}
-
-		if (cache.isEmpty() || cache.back() != '\n') return;
-		ParseMessage(cache);
-		cache.clear();
-	}
+	// acknowledge first, so anything the socket pushes while we're draining earns another pass
+	ircSocket->Acknowledge();
+	lastReceived.start();
+	while (std::optional<IRC::Message> message=ircSocket->Received().Pop()) ParseMessage(*message);
+	if (ircSocket->Stalled()) QMetaObject::invokeMethod(ircSocket,&IRCSocket::Resume,Qt::QueuedConnection);
 }
 
-void Channel::ParseMessage(const QString message)
+void Channel::ParseMessage(const IRC::Message &message)
 {
 	static const char* OPERATION_PARSE_MESSAGE="message parsing";
-	emit Print(message,OPERATION_PARSE_MESSAGE);
-	QStringView window(message);
-
-	// grab prefix if one exists
-	std::optional<QStringView> prefix=StringView::Take(window,'@',' ');
-	std::optional<QStringView> source=StringView::Take(window,':',' ');
-	if (!source) emit Print("Source is missing from message",OPERATION_PARSE_MESSAGE); // make a note, but per the spec, source is optional
-	std::optional<QStringView> command=StringView::Take(window,' ');
-	if (!command)
+	emit Print(QString::fromUtf8(message.Line()),OPERATION_PARSE_MESSAGE);
+
+	if (message.Source().isEmpty()) emit Print("Source is missing from message",OPERATION_PARSE_MESSAGE); // make a note, but per the spec, source is optional
+	if (!message.Valid())
 	{
 		emit Print("Command is missing from message",OPERATION_PARSE_MESSAGE);
 		return;
 	}
-	std::optional<QStringView> parameters;
-	if (!window.isEmpty()) parameters=StringView::Take(window,':');
-	std::optional<QStringView> finalParameter;
-	if (!window.isEmpty()) finalParameter=StringView::Take(window,'\n');
-	DispatchMessage(prefix ? prefix->toString() : QString(), source ? source->toString() : QString(), command->toString(), parameters ? parameters->toString().split(' ',Qt::SkipEmptyParts) : QStringList(), finalParameter ? finalParameter->toString() : QString());
+	DispatchMessage(message);
 }
 
-void Channel::DispatchMessage(QString prefix,QString source,QString command,QStringList parameters,QString finalParameter)
+void Channel::DispatchMessage(const IRC::Message &message)
 {
 	static const char *OPERATION_DISPATCH="dispatch message";
 
-	bool numeric=false;
-	int code=command.toInt(&numeric);
-	if (!numeric)
+	const QByteArrayView command=message.Command();
+	int code=-1;
+	if (auto [end,error]=std::from_chars(command.data(),command.data()+command.size(),code); error != std::errc() || end != command.data()+command.size())
 	{
-		auto nonNumericIRCCommand=nonNumericIRCCommands.find(command);
-		if (nonNumericIRCCommand != nonNumericIRCCommands.end())
-			code=static_cast<int>(nonNumericIRCCommand->second);
-		else
-			code=-1;
+		std::optional<IRCCommand> nonNumericIRCCommand=nonNumericIRCCommands.Find(command);
+		code=nonNumericIRCCommand ? static_cast<int>(*nonNumericIRCCommand) : -1;
 	}
 	switch (code) // I'd rather static_cast the code, but if Twitch sends a command I haven't implemented, code will be outside the enum's range
 	{
 	case static_cast<int>(IRCCommand::RPL_WELCOME):
+		backoff=RECONNECT_BACKOFF_INITIAL;
 		break;
 	case static_cast<int>(IRCCommand::RPL_YOURHOST):
 		break;
@@ -168,54 +217,63 @@ void Channel::DispatchMessage(QString prefix,QString source,QString command,QStr
 		break;
 	case static_cast<int>(IRCCommand::RPL_NAMREPLY):
 	{
-		emit Print(QString("User list received:\n%1").arg(finalParameter.replace(' ','\n')));
-		const QStringList rows=finalParameter.split(' ');
-		for (const QString &row : rows)
+		// Twitch doesn't follow the spec here and returns mutliple names deliminted by \n between each space
+		QStringList users;
+		const QByteArrayView names=message.Trailing().value_or(QByteArrayView{});
+		qsizetype start=0;
+		for (qsizetype index=0; index <= names.size(); index++)
 		{
-			const QStringList users=row.split('\n'); // Twitch doesn't follow the spec here and returns mutliple names deliminted by \n between each space
-			for (const QString &user : users) emit Joined(user);
+			if (index < names.size() && names.at(index) != ' ' && names.at(index) != '\n') continue;
+			if (index > start) users.append(QString::fromUtf8(names.sliced(start,index-start)));
+			start=index+1;
 		}
+		emit Print(QString("User list received:\n%1").arg(users.join('\n')));
+		for (const QString &user : users) QueueJoin(user);
 		break;
 	}
 	case static_cast<int>(IRCCommand::RPL_ENDOFNAMES):
 		break;
 	case static_cast<int>(IRCCommand::RPL_ENDOFMOTD):
 		emit Connected();
-		emit Print("Server accepted authentication; requesting capabilities...",OPERATION_DISPATCH);
-		RequestCapabilities();
+		emit Print("Server accepted authentication",OPERATION_DISPATCH);
 		break;
 	case static_cast<int>(IRCCommand::ERR_UNKNOWNCOMMAND):
 		emit Print("Server didn't recognize command",OPERATION_DISPATCH);
 		break;
 	case static_cast<int>(IRCCommand::CAP):
-		ParseCapabilities(parameters,finalParameter);
+		ParseCapabilities(message);
 		break;
 	case static_cast<int>(IRCCommand::JOIN):
-		DispatchJoin(source);
+		DispatchJoin(message);
 		break;
 	case static_cast<int>(IRCCommand::PART):
-		DispatchPart(source);
+		DispatchPart(message);
 		break;
 	case static_cast<int>(IRCCommand::CLEARMSG):
-		emit Deleted(prefix);
+		emit Deleted(message);
 		break;
 	case static_cast<int>(IRCCommand::CLEARCHAT):
-		emit Deleted(prefix);
+		emit Deleted(message);
 		break;
 	case static_cast<int>(IRCCommand::PRIVMSG):
-		emit Dispatch(prefix,source,parameters,finalParameter);
+		emit Dispatch(message);
 		break;
 	case static_cast<int>(IRCCommand::NOTICE):
-		ParseNotice(finalParameter);
+		ParseNotice(QString::fromUtf8(message.Trailing().value_or(QByteArrayView{})));
+		break;
+	case static_cast<int>(IRCCommand::USERSTATE):
+		ParseUserState(message);
 		break;
 	case static_cast<int>(IRCCommand::USERNOTICE):
-		ParseUserNotice(prefix,finalParameter);
+		ParseUserNotice(QString::fromUtf8(message.Tags()),QString::fromUtf8(message.Trailing().value_or(QByteArrayView{})));
 		break;
+	case static_cast<int>(IRCCommand::PONG):
+		break; // receiving anything at all is what counts, which Drain() already noted
 	case static_cast<int>(IRCCommand::PING):
-		emit Ping(finalParameter);
+		emit Ping(QString::fromUtf8(message.Trailing().value_or(QByteArrayView{})));
 		break;
 	default:
-		emit Print(QString("Unrecognized command '%1' received from server").arg(command),OPERATION_DISPATCH);
+		emit Print(QString("Unrecognized command '%1' received from server").arg(QString::fromUtf8(command)),OPERATION_DISPATCH);
 	}
 }
 
@@ -226,32 +284,145 @@ void Channel::SendMessage(QString prefix,QString command,QStringList parameters,
 	if (!parameters.isEmpty()) message.append(QString(" %1").arg(parameters.join(' ')));
 	if (!finalParameter.isEmpty()) message.append(QString(" :%1").arg(finalParameter));
 	message.append("\r\n");
-	ircSocket->write(StringConvert::ByteArray(message));
+
+	Traffic traffic=Traffic::CONTROL;
+	std::size_t cost=1;
+	if (command == IRC_COMMAND_JOIN)
+	{
+		traffic=Traffic::JOIN;
+		cost=parameters.value(0).count(',')+1;
+	}
+	if (command == IRC_COMMAND_PRIVMSG)
+	{
+		if (finalParameter.startsWith(IRC_WHISPER_PREFIX))
+		{
+			traffic=Traffic::WHISPER;
+		}
+		else
+		{
+			Queue(Traffic::CHAT,StringConvert::ByteArray(message),cost,StringConvert::ByteArray(parameters.value(0)));
+			return;
+		}
+	}
+	Queue(traffic,StringConvert::ByteArray(message),cost);
+}
+
+void Channel::Queue(Traffic traffic,QByteArray line,std::size_t cost,QByteArray room)
+{
+	Lane &lane=Outbound(traffic);
+	if (lane.lines.size() >= OUTBOUND_QUEUE_LIMIT)
+	{
+		lane.dropped++;
+		emit Print(QString("Outbound queue is full, dropping message (%1 dropped so far)").arg(lane.dropped),OPERATION_OUTBOUND);
+		return;
+	}
+	lane.lines.push({std::move(line),cost,std::move(room)});
+
+	// everything queued during this pass through the event loop goes out in one write,
+	// but control traffic shouldn't sit behind a timer that's waiting on a rate limit
+	if (!outboundTimer.isActive() || traffic == Traffic::CONTROL) outboundTimer.start(0);
+}
+
+void Channel::Flush()
+{
+	if (socketState != QAbstractSocket::ConnectedState) return; // leave it all queued until we're back
+
+	QByteArray batch;
+	std::optional<std::chrono::milliseconds> wait;
+	for (Lane &lane : outbound)
+	{
+		while (!lane.lines.empty())
+		{
+			const Pending &pending=lane.lines.front();
+
+			// chat has to fit both the room's limit and the limit across all rooms, so check both before taking from either
+			RateLimit::SlidingWindow *roomLimit=pending.room.isEmpty() ? nullptr : &Chat(pending.room).limit;
+			const std::chrono::milliseconds blocked=std::max(lane.limit ? lane.limit->Wait(pending.cost) : std::chrono::milliseconds(0),roomLimit ? roomLimit->Wait(pending.cost) : std::chrono::milliseconds(0));
+			if (blocked > std::chrono::milliseconds(0))
+			{
+				if (!wait || blocked < *wait) wait=blocked;
+				break;
+			}
+			if (lane.limit) lane.limit->Take(pending.cost);
+			if (roomLimit) roomLimit->Take(pending.cost);
+			batch.append(pending.line);
+			lane.lines.pop();
+			lane.sent++;
+		}
+	}
+
+	if (!batch.isEmpty())
+	{
+		QMetaObject::invokeMethod(ircSocket,[socket=ircSocket,batch]() {
+			socket->write(batch);
+		},Qt::QueuedConnection);
+	}
+	if (wait) outboundTimer.start(std::max(*wait,std::chrono::milliseconds(1)));
+}
+
+void Channel::Say(const QString &room,const QString &message)
+{
+	SendMessage(QString(),IRC_COMMAND_PRIVMSG,{room},message);
 }
 
-void Channel::ParseCapabilities(const QStringList &parameters,const QString &capabilities)
+Channel::Backpressure Channel::InboundMetrics() const
+{
+	Backpressure backpressure {
+		.depth=ircSocket->Received().Size(),
+		.stalls=ircSocket->Stalls()
+	};
+	for (const Channel *shard : shards)
+	{
+		const Backpressure candidate=shard->InboundMetrics();
+		backpressure.depth+=candidate.depth;
+		backpressure.stalls+=candidate.stalls;
+	}
+	return backpressure;
+}
+
+Channel::Metrics Channel::OutboundMetrics() const
+{
+	Metrics metrics {0,0,0};
+	for (const Lane &lane : outbound)
+	{
+		metrics.depth+=lane.lines.size();
+		metrics.sent+=lane.sent;
+		metrics.dropped+=lane.dropped;
+	}
+	for (const Channel *shard : shards)
+	{
+		const Metrics candidate=shard->OutboundMetrics();
+		metrics.depth+=candidate.depth;
+		metrics.sent+=candidate.sent;
+		metrics.dropped+=candidate.dropped;
+	}
+	return metrics;
+}
+
+void Channel::ParseCapabilities(const IRC::Message &message)
 {
 	// must contain at least client identifier name (or *) and subcommand
-	if (parameters.size() < 2)
+	std::optional<QByteArrayView> subCommand=message.Parameter(1); // parameter 0 is client identifier, which I don't need right now
+	if (!subCommand)
 	{
 		emit Print("Capabilities message is malformatted",OPERATION_CAPABILITIES);
 		return;
 	}
 
-	DispatchCapabilities(parameters.at(1),capabilities.split(' ')); // parameters.at(0) is client identifier, which I don't need right now
+	DispatchCapabilities(*subCommand,message.Trailing().value_or(QByteArrayView{}));
 }
 
-void Channel::DispatchCapabilities(const QString &subCommand,const QStringList &capabilities)
+void Channel::DispatchCapabilities(QByteArrayView subCommand,QByteArrayView capabilities)
 {
 	int code=-1;
-	if (auto capabilitiesSubcommand=capabilitiesSubcommands.find(subCommand); capabilitiesSubcommand != capabilitiesSubcommands.end()) code=static_cast<int>(capabilitiesSubcommand->second);
+	if (std::optional<CapabilitiesSubcommand> capabilitiesSubcommand=capabilitiesSubcommands.Find(subCommand); capabilitiesSubcommand) code=static_cast<int>(*capabilitiesSubcommand);
 	switch (code)
 	{
 	case static_cast<int>(CapabilitiesSubcommand::ACK):
-		RequestJoin();
+		emit Print(QString("Server granted capabilities: %1").arg(QString::fromUtf8(capabilities)),OPERATION_CAPABILITIES);
 		break;
 	case static_cast<int>(CapabilitiesSubcommand::NAK):
-		emit Print(QString("Capability was rejected by server: %1").arg(capabilities.join(' ')),OPERATION_CAPABILITIES);
+		emit Print(QString("Capability was rejected by server: %1").arg(QString::fromUtf8(capabilities)),OPERATION_CAPABILITIES);
 		break;
 	default:
 		emit Print("Unrecognized capabilities subcommand",OPERATION_CAPABILITIES);
@@ -261,14 +432,14 @@ void Channel::DispatchCapabilities(const QString &subCommand,const QStringList &
 
 void Channel::ParseNotice(const QString &message)
 {
-	auto notice=notices.find(message);
-	if (notice == notices.end())
+	std::optional<Notice> notice=notices.Find(QStringView(message));
+	if (!notice)
 	{
 		emit Print("Unrecognized notice received",OPERATION_NOTICES);
 		return;
 	}
 
-	switch (notice->second)
+	switch (*notice)
 	{
 	case Notice::DENIED:
 		emit Print("Server denied login",OPERATION_NOTICES);
@@ -287,16 +458,74 @@ void Channel::ParseUserNotice(const QString &prefix,const QString &message)
 
 void Channel::Connect()
 {
-	QMetaObject::invokeMethod(ircSocket,[this]() {
-		// trigger using event loop so the socket operation doesn't freeze the UI
-		ircSocket->connectToHost(TWITCH_HOST,TWITCH_PORT);
-	},Qt::QueuedConnection);
-	emit Print("Connecting to IRC...",OPERATION_CONNECTION);
+	ListRooms();
+	if (rooms.size() > ROOMS_PER_CONNECTION && shards.empty()) Shard();
+
+	reconnect=true;
+	reconnectTimer.stop();
+	if (socketState != QAbstractSocket::UnconnectedState) return;
+
+	emit Print(QString("Connecting to IRC (%1:%2)...").arg(static_cast<QString>(settingHost),QString::number(static_cast<quint16>(settingPort))),OPERATION_CONNECTION);
+	if (!address.isNull())
+	{
+		ConnectToHost();
+		return;
+	}
+
+	// resolve once and hold onto the address, so a reconnect doesn't wait on DNS
+	socketState=QAbstractSocket::HostLookupState;
+	QHostInfo::lookupHost(static_cast<QString>(settingHost),this,[this](const QHostInfo &host) {
+		if (host.error() != QHostInfo::NoError || host.addresses().isEmpty())
+		{
+			emit Print(QString("Failed to resolve %1 (%2)").arg(host.hostName(),host.errorString()),OPERATION_CONNECTION);
+			socketState=QAbstractSocket::UnconnectedState;
+			if (reconnect) ScheduleReconnect();
+			return;
+		}
+		address=host.addresses().first();
+		if (reconnect) ConnectToHost();
+	});
 }
 
 void Channel::Disconnect()
 {
-	ircSocket->disconnectFromHost();
+	reconnect=false;
+	reconnectTimer.stop();
+	QMetaObject::invokeMethod(ircSocket,&IRCSocket::disconnectFromHost,Qt::QueuedConnection);
+}
+
+void Channel::ConnectToHost()
+{
+	socketState=QAbstractSocket::HostLookupState; // don't let a second Connect() through before the socket reports back
+	QMetaObject::invokeMethod(ircSocket,[socket=ircSocket,address=address,port=static_cast<quint16>(settingPort)]() {
+		socket->connectToHost(address,port);
+	},Qt::QueuedConnection);
+}
+
+void Channel::ScheduleReconnect()
+{
+	if (reconnectTimer.isActive()) return;
+
+	// wait somewhere between half and all of the current backoff, so a Twitch-wide
+	// outage doesn't have every client hammering the server on the same schedule
+	const int ceiling=static_cast<int>(backoff.count());
+	const std::chrono::milliseconds delay(Random::Bounded(ceiling/2,ceiling));
+	backoff=std::min(backoff*2,RECONNECT_BACKOFF_MAXIMUM);
+	emit Print(QString("Reconnecting in %1 seconds").arg(QString::number(delay.count()/1000.0,'f',1)),OPERATION_CONNECTION);
+	reconnectTimer.start(delay);
+}
+
+void Channel::CheckLiveness()
+{
+	// the server pings us on its own schedule, but a half-open connection can go
+	// quiet long before it gets around to that, so ask for proof of life ourselves
+	if (lastReceived.hasExpired(TimeConvert::Interval(LIVENESS_INTERVAL)*2))
+	{
+		emit Print("Server stopped responding, dropping connection",OPERATION_CONNECTION);
+		QMetaObject::invokeMethod(ircSocket,&IRCSocket::abort,Qt::QueuedConnection);
+		return;
+	}
+	if (lastReceived.hasExpired(TimeConvert::Interval(LIVENESS_INTERVAL))) SendMessage(QString(),"PING",{},static_cast<QString>(settingHost));
 }
 
 void Channel::Authenticate()
@@ -310,6 +539,11 @@ void Channel::Authenticate()
 	emit Print(QString("Sending credentials: %1").arg(QString("%1 %2\n").arg(IRC_COMMAND_USER,static_cast<QString>(security.Administrator()))),OPERATION_AUTHENTICATION);
 	SendMessage(QString(),"PASS",{QString("oauth:%1").arg(static_cast<QString>(security.OAuthToken()))},QString());
 	SendMessage(QString(),"NICK",{security.Administrator()},QString());
+
+	// Twitch doesn't make us wait for the end of the MOTD or the CAP ACK before asking for more,
+	// so everything goes out in the same write and the handshake costs one round trip
+	RequestCapabilities();
+	RequestJoin();
 }
 
 void Channel::RequestCapabilities()
@@ -319,46 +553,106 @@ void Channel::RequestCapabilities()
 
 void Channel::RequestJoin()
 {
-	SendMessage(QString(),IRC_COMMAND_JOIN,{QString("#%1").arg(settingChannel ? static_cast<QString>(settingChannel).toLower() : static_cast<QString>(security.Administrator()).toLower())},QString());
+	// Twitch charges the JOIN limit per room, not per line, so keep each line small
+	// enough that it fits in the window
+	for (qsizetype index=0; index < rooms.size(); index+=ROOMS_PER_JOIN) SendMessage(QString(),IRC_COMMAND_JOIN,{rooms.mid(index,ROOMS_PER_JOIN).join(',')},QString());
 }
 
-void Channel::DispatchJoin(const QString &source)
+void Channel::Shard()
 {
-	std::optional<Hostmask> hostmask=ParseSource(source);
-	if (hostmask)
+	// every connection past this one is a bare channel that forwards what it hears,
+	// so the rest of the application only ever talks to the primary channel
+	for (qsizetype index=ROOMS_PER_CONNECTION; index < rooms.size(); index+=ROOMS_PER_CONNECTION)
 	{
-		if (hostmask->nick == static_cast<QString>(security.Administrator()))
-			emit Joined();
-		else
-			emit Joined(hostmask->nick);
+		Channel *shard=new Channel(security,this);
+		shard->rooms=rooms.mid(index,ROOMS_PER_CONNECTION);
+		// Twitch counts everything we send per account, not per connection
+		for (Traffic traffic : {Traffic::JOIN,Traffic::WHISPER,Traffic::CHAT}) shard->Outbound(traffic).limit=Outbound(traffic).limit;
+		shard->chatRooms=chatRooms;
+		connect(shard,&Channel::Print,this,&Channel::Print);
+		connect(shard,&Channel::Dispatch,this,&Channel::Dispatch);
+		connect(shard,&Channel::Deleted,this,&Channel::Deleted);
+		connect(shard,&Channel::JoinedBatch,this,&Channel::JoinedBatch);
+		connect(shard,&Channel::PartedBatch,this,&Channel::PartedBatch);
+		shards.push_back(shard);
+		emit Print(QString("Opening another connection for %1 rooms").arg(shard->rooms.size()),OPERATION_CONNECTION);
+		shard->Connect();
 	}
+	rooms.resize(ROOMS_PER_CONNECTION);
 }
 
-void Channel::DispatchPart(const QString &source)
+QString Channel::Room()
 {
-	std::optional<Hostmask> hostmask=ParseSource(source);
-	if (hostmask) emit Parted(hostmask->nick);
+	return QString("#%1").arg(settingChannel ? static_cast<QString>(settingChannel).toLower() : static_cast<QString>(security.Administrator()).toLower());
 }
 
-std::optional<Hostmask> Channel::ParseSource(const QString &source)
+void Channel::DispatchJoin(const IRC::Message &message)
 {
-	QStringView window(source);
-	std::optional<QStringView> nick=StringView::Take(window,'!');
-	if (!nick) return std::nullopt;
-	std::optional<QStringView> user=StringView::Take(window,'@');
-	if (!user) return std::nullopt;
-	if (window.isEmpty()) return std::nullopt;
-	return Hostmask{
-		.nick=nick->toString(),
-		.user=user->toString(),
-		.host=window.toString()
-	};
+	std::optional<QByteArrayView> nick=message.Nick();
+	if (!nick) return;
+	const QString user=QString::fromUtf8(*nick);
+	if (user == static_cast<QString>(security.Administrator()))
+	{
+		// only the primary room announces that we're in, and only on the primary connection
+		if (message.Parameter(0).value_or(QByteArrayView{}) == StringConvert::ByteArray(Room())) emit Joined();
+	}
+	else
+	{
+		QueueJoin(user);
+	}
+}
+
+void Channel::DispatchPart(const IRC::Message &message)
+{
+	std::optional<QByteArrayView> nick=message.Nick();
+	if (nick) QueuePart(QString::fromUtf8(*nick));
+}
+
+void Channel::QueueJoin(const QString &user)
+{
+	// someone who leaves and comes back before the batch goes out never left as far as anyone else is concerned
+	if (!pendingParts.remove(user)) pendingJoins.insert(user);
+	if (!rosterTimer.isActive()) rosterTimer.start(0);
+}
+
+void Channel::QueuePart(const QString &user)
+{
+	if (!pendingJoins.remove(user)) pendingParts.insert(user);
+	if (!rosterTimer.isActive()) rosterTimer.start(0);
+}
+
+void Channel::FlushRoster()
+{
+	if (!pendingParts.isEmpty()) emit PartedBatch(pendingParts.values());
+	if (!pendingJoins.isEmpty()) emit JoinedBatch(pendingJoins.values());
+	pendingParts.clear();
+	pendingJoins.clear();
+}
+
+void Channel::ParseUserState(const IRC::Message &message)
+{
+	// moderators (and the broadcaster) get a much larger chat allowance, but only in the rooms they moderate
+	const std::optional<QByteArrayView> room=message.Parameter(0);
+	if (!room) return;
+	bool candidate=message.Tag("mod").value_or(QByteArrayView{}) == QByteArrayView("1");
+	if (std::optional<QByteArrayView> badges=message.Tag("badges"); badges && badges->startsWith("broadcaster/")) candidate=true;
+	ChatRoom &chat=Chat(room->toByteArray());
+	if (candidate == chat.moderator) return;
+	chat.moderator=candidate;
+	chat.limit.Limit(chat.moderator ? RATE_LIMIT_CHAT_MODERATOR : RATE_LIMIT_CHAT,RATE_LIMIT_CHAT_WINDOW);
+	emit Print(QString("Chat rate limit in %1 is now %2 messages per 30 seconds").arg(QString::fromUtf8(*room),QString::number(chat.moderator ? RATE_LIMIT_CHAT_MODERATOR : RATE_LIMIT_CHAT)),OPERATION_OUTBOUND);
+}
+
+Channel::ChatRoom& Channel::Chat(const QByteArray &room)
+{
+	// a room we haven't heard a USERSTATE from yet gets the smaller allowance until we know better
+	return chatRooms->try_emplace(room,ChatRoom{.moderator=false,.limit={RATE_LIMIT_CHAT,RATE_LIMIT_CHAT_WINDOW}}).first->second;
 }
 
 void Channel::SocketError(QAbstractSocket::SocketError error)
 {
-	Q_UNUSED(error)
-	emit Print(QString("Failed to connect to server (%1)").arg(ircSocket->errorString()),OPERATION_CONNECTION);
+	// the cached address may be why we couldn't connect, so look it up again next time
+	if (error == QAbstractSocket::ConnectionRefusedError || error == QAbstractSocket::HostNotFoundError || error == QAbstractSocket::SocketTimeoutError || error == QAbstractSocket::NetworkError) address.clear();
 }
 
 void Channel::Pong(const QString &token)
@@ -371,23 +665,85 @@ ApplicationSetting& Channel::Name()
 	return settingChannel;
 }
 
+void Channel::ListRooms()
+{
+	if (!rooms.isEmpty()) return;
+	rooms.append(Room());
+	for (const QString &room : static_cast<QString>(settingRooms).split(',',Qt::SkipEmptyParts))
+	{
+		QString name=room.trimmed().toLower();
+		if (!name.startsWith('#')) name.prepend('#');
+		if (!rooms.contains(name)) rooms.append(name);
+	}
+}
+
+QStringList Channel::Rooms()
+{
+	// our own room always comes first, followed by the rest in the order they were configured,
+	// whichever connection they ended up on
+	ListRooms();
+	QStringList all=rooms;
+	for (const Channel *shard : shards) all.append(shard->rooms);
+	return all;
+}
+
 ApplicationSetting& Channel::Protection()
 {
 	return settingProtect;
 }
 
-QByteArray IRCSocket::Read()
+IRCSocket::IRCSocket(QObject *parent) : QTcpSocket(parent),
+	notified(false),
+	stalled(false),
+	stalls(0)
 {
-	return readAll();
+	// when we stop reading because the inbox is full, let the kernel's buffer and
+	// then the TCP window push back on the server instead of buffering without limit
+	setReadBufferSize(1024*1024);
+	connect(this,&IRCSocket::readyRead,this,&IRCSocket::Ingest);
+	connect(this,&IRCSocket::errorOccurred,this,[this]() {
+		emit Print(QString("Failed to connect to server (%1)").arg(errorString()),OPERATION_CONNECTION);
+	});
 }
 
-std::optional<char> IRCSocket::Pop()
+void IRCSocket::Ingest()
 {
-	char character='\0';
-	if (!getChar(&character))
+	bool delivered=false;
+	while (!inbox.Full())
+	{
+		std::optional<QByteArrayView> line=framer.Line();
+		if (!line)
+		{
+			const qint64 received=framer.Fill(*this);
+			if (received < 0) emit Print("Failed to read data from socket",OPERATION_RECEIVE);
+			if (received <= 0) break;
+			continue;
+		}
+
+		// the line points into the framer's buffer, which the next Fill() rewrites, so the
+		// message gets its own copy before it crosses over to the other thread
+		IRC::Message message(*line);
+		message.Detach();
+		inbox.Push(std::move(message));
+		delivered=true;
+	}
+
+	if (inbox.Full() && !stalled.exchange(true,std::memory_order_acq_rel))
 	{
-		emit Print("Failed to read data from socket",OPERATION_RECEIVE);
-		return std::nullopt;
+		stalls.fetch_add(1,std::memory_order_relaxed);
+		emit Print("Channel isn't keeping up with the server, pausing reads",OPERATION_RECEIVE);
+		delivered=true; // make sure a drain is coming to see that we stalled, or nothing will ever resume us
 	}
-	return {character};
+	if (delivered && !notified.exchange(true,std::memory_order_acq_rel)) emit MessagesAvailable();
+}
+
+void IRCSocket::Resume()
+{
+	if (!stalled.exchange(false,std::memory_order_acq_rel)) return;
+	Ingest();
+}
+
+QByteArray IRCSocket::Read()
+{
+	return readAll();
 }
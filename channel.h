@@ -2,25 +2,43 @@
 
 #include <QTcpSocket>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QThread>
+#include <QSet>
+#include <queue>
+#include <unordered_map>
+#include <memory>
+#include "globals.h"
 #include "settings.h"
 #include "security.h"
+#include "irc.h"
 
+// Lives on the channel's I/O thread. Lines are framed and parsed there, then handed
+// to the channel through the inbox so a busy GUI thread never holds up reading.
 class IRCSocket : public QTcpSocket
 {
 	Q_OBJECT
 public:
-	IRCSocket(QObject *parent=nullptr) : QTcpSocket(parent) { }
+	using Inbox=Container::RingBuffer<IRC::Message,4096>;
+	IRCSocket(QObject *parent=nullptr);
 	QByteArray Read();
-	std::optional<char> Pop();
+	Inbox& Received() { return inbox; }
+	void Acknowledge() { notified.store(false,std::memory_order_release); }
+	bool Stalled() const { return stalled.load(std::memory_order_acquire); }
+	quint64 Stalls() const { return stalls.load(std::memory_order_relaxed); }
+protected:
+	IRC::Framer framer;
+	Inbox inbox;
+	std::atomic<bool> notified; //! set when the channel has been told there's something to drain
+	std::atomic<bool> stalled; //! set while the inbox is full and we've stopped reading
+	std::atomic<quint64> stalls;
 signals:
 	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("network socket"));
-};
-
-struct Hostmask
-{
-	QString nick;
-	QString user;
-	QString host;
+	void MessagesAvailable();
+public slots:
+	void Ingest();
+	void Resume();
 };
 
 class Channel : public QObject
@@ -34,45 +52,119 @@ class Channel : public QObject
 		JOIN_CHANNEL,
 		DISPATCH
 	};
+	enum class Traffic
+	{
+		CONTROL,
+		JOIN,
+		WHISPER,
+		CHAT,
+		COUNT
+	};
+	struct Pending
+	{
+		QByteArray line;
+		std::size_t cost; //! how many sends the line counts as (a batched JOIN counts once per room)
+		QByteArray room; //! only set for chat, which is limited by the room it goes to as well
+	};
+	struct ChatRoom
+	{
+		bool moderator { false };
+		RateLimit::SlidingWindow limit; //! what Twitch allows us in this room, depending on whether we moderate it
+	};
+	using ChatRooms=std::unordered_map<QByteArray,ChatRoom>;
+	struct Lane
+	{
+		std::queue<Pending> lines;
+		std::shared_ptr<RateLimit::SlidingWindow> limit; //! control traffic (PASS, NICK, CAP, PONG) isn't limited
+		quint64 sent { 0 };
+		quint64 dropped { 0 };
+	};
 public:
-	Channel(Security &security,QObject *parent=nullptr) : Channel(security,nullptr,parent) { }
-	Channel(Security &security,IRCSocket *socket,QObject *parent=nullptr);
+	struct Metrics
+	{
+		qsizetype depth;
+		quint64 sent;
+		quint64 dropped;
+	};
+	struct Backpressure
+	{
+		std::size_t depth;
+		quint64 stalls;
+	};
+	Channel(Security &security,QObject *parent=nullptr);
 	~Channel();
 	void Connect();
 	void Disconnect();
 	ApplicationSetting& Name();
 	ApplicationSetting& Protection();
+	Metrics OutboundMetrics() const;
+	Backpressure InboundMetrics() const;
+	QString Room();
+	QStringList Rooms();
 protected:
 	Security &security;
 	ApplicationSetting settingChannel;
 	ApplicationSetting settingProtect;
-	IRCSocket *ircSocket;
-	void ParseMessage(const QString message);
-	void DispatchMessage(QString prefix,QString source,QString command,QStringList parameters,QString finalParamter);
+	ApplicationSetting settingRooms;
+	ApplicationSetting settingHost;
+	ApplicationSetting settingPort;
+	QThread ioThread;
+	IRCSocket *ircSocket; //! owned by the I/O thread, so only touch it through invokeMethod() or signals
+	QAbstractSocket::SocketState socketState; //! last state the socket reported, since asking it directly would cross threads
+	QSet<QString> pendingJoins;
+	QSet<QString> pendingParts;
+	QTimer rosterTimer;
+	QStringList rooms;
+	std::vector<Channel*> shards; //! extra connections for rooms that don't fit on this one
+	std::array<Lane,static_cast<std::size_t>(Traffic::COUNT)> outbound;
+	std::shared_ptr<ChatRooms> chatRooms; //! shared with the shards, since Twitch counts chat per account, not per connection
+	QTimer outboundTimer;
+	bool reconnect; //! cleared by an explicit Disconnect() so we don't fight the user
+	std::chrono::milliseconds backoff;
+	QTimer reconnectTimer;
+	QTimer livenessTimer;
+	QElapsedTimer lastReceived;
+	QHostAddress address; //! resolved once so reconnecting doesn't wait on DNS
+	Lane& Outbound(Traffic traffic) { return outbound[static_cast<std::size_t>(traffic)]; }
+	void ParseMessage(const IRC::Message &message);
+	void DispatchMessage(const IRC::Message &message);
 	void SendMessage(QString prefix,QString command,QStringList parameters,QString finalParamter);
-	void ParseCapabilities(const QStringList &parameters,const QString &capabilities);
-	void DispatchCapabilities(const QString &subCommand,const QStringList &capabilities);
+	void Queue(Traffic traffic,QByteArray line,std::size_t cost=1,QByteArray room=QByteArray());
+	ChatRoom& Chat(const QByteArray &room);
+	void ListRooms();
+	void Shard();
+	void ScheduleReconnect();
+	void ConnectToHost();
+	void ParseCapabilities(const IRC::Message &message);
+	void DispatchCapabilities(QByteArrayView subCommand,QByteArrayView capabilities);
 	void ParseNotice(const QString &message);
 	void ParseUserNotice(const QString &prefix,const QString &message);
 	void Authenticate();
 	void RequestCapabilities();
 	void RequestJoin();
-	void DispatchJoin(const QString &source);
-	void DispatchPart(const QString &source);
-	std::optional<Hostmask> ParseSource(const QString &source);
+	void DispatchJoin(const IRC::Message &message);
+	void DispatchPart(const IRC::Message &message);
+	void QueueJoin(const QString &user);
+	void QueuePart(const QString &user);
+	void ParseUserState(const IRC::Message &message);
 signals:
 	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("channel"));
-	void Dispatch(const QString &prefix,const QString &source,const QStringList &parameters,const QString &message);
+	void Dispatch(const IRC::Message &message);
 	void Connected();
 	void Disconnected();
 	void Denied();
 	void Joined();
-	void Joined(const QString &user);
-	void Parted(const QString &user);
-	void Deleted(const QString &prefix);
+	void JoinedBatch(const QStringList &users);
+	void PartedBatch(const QStringList &users);
+	void Deleted(const IRC::Message &message);
 	void Ping(const QString &token);
+public slots:
+	void Say(const QString &room,const QString &message);
 protected slots:
-	void DataAvailable();
+	void Flush();
+	void CheckLiveness();
+	void FlushRoster();
+	void Drain();
 	void SocketError(QAbstractSocket::SocketError error);
 	void Pong(const QString &token);
 };
@@ -0,0 +1,153 @@
+#include "cooldown.h"
+
+namespace Cooldown
+{
+	void TimingWheel::Schedule(quint64 key,std::chrono::milliseconds delay)
+	{
+		// always at least one tick out, so nothing lands in the slot that's being drained
+		const quint64 ticks=std::max<quint64>(1,static_cast<quint64>((delay+RESOLUTION-std::chrono::milliseconds(1))/RESOLUTION));
+		if (ticks < SLOTS)
+		{
+			inner[(tick+ticks)%SLOTS].push_back(key);
+			return;
+		}
+
+		// anything past the end of the outer wheel waits in its last slot and gets another look when it comes down
+		const quint64 block=std::min((tick+ticks)/SLOTS,tick/SLOTS+SLOTS-1);
+		outer[block%SLOTS].push_back(key);
+	}
+
+	Engine::Engine(QObject *parent) : QObject(parent)
+	{
+		ticker.setInterval(TimingWheel::RESOLUTION);
+		connect(&ticker,&QTimer::timeout,this,[this]() {
+			wheel.Advance([this](quint64 key) {
+				Expire(key);
+			});
+			if (states.empty()) ticker.stop();
+		});
+	}
+
+	void Engine::Global(const Limit &limit)
+	{
+		if (limit.Enabled())
+			global.emplace(limit.uses,limit.window);
+		else
+			global.reset();
+	}
+
+	void Engine::Limited(const Limit &limit)
+	{
+		limited=limit;
+	}
+
+	void Engine::Forget(const QString &command)
+	{
+		// The command's rules changed, so everyone starts fresh under the new ones.
+		// The slot stays with the name and picks up the new policy the next time the
+		// command is used, so editing a command over and over doesn't keep adding slots.
+		auto candidate=commands.find(command);
+		if (candidate == commands.end()) return;
+		const quint32 index=candidate->second;
+		stale[index]=true;
+		std::erase_if(states,[index](const auto &state) {
+			return static_cast<quint32>(state.first >> 32) == index;
+		});
+	}
+
+	Verdict Engine::Check(const QString &command,const Policy &policy,quint32 viewer,bool limited)
+	{
+		static const std::chrono::milliseconds NOW(0);
+
+		// look first, and only spend tokens once every bucket has agreed,
+		// so being turned away by one doesn't drain the others
+		const Clock::time_point now=Clock::now();
+		State *restricted=nullptr;
+		if (limited && this->limited.Enabled())
+		{
+			restricted=Viewer((static_cast<quint64>(LIMITED_COMMAND) << 32)|viewer,this->limited,now);
+			if (restricted->bucket.Wait() > NOW) return Verdict::LIMITED;
+		}
+
+		if (global && global->Wait() > NOW) return Verdict::THROTTLED;
+
+		const quint32 index=Index(command,policy);
+		std::optional<RateLimit::TokenBucket> &shared=buckets[index];
+		if (shared && shared->Wait() > NOW) return Verdict::THROTTLED;
+
+		const Limit &own=policies[index].viewer;
+		State *personal=own.Enabled() ? Viewer((static_cast<quint64>(index) << 32)|viewer,own,now) : nullptr;
+		if (personal && personal->bucket.Wait() > NOW) return Verdict::THROTTLED;
+
+		if (restricted) Take(*restricted,this->limited,now);
+		if (global) global->Take();
+		if (shared) shared->Take();
+		if (personal) Take(*personal,own,now);
+		return Verdict::ALLOWED;
+	}
+
+	quint32 Engine::Index(const QString &command,const Policy &policy)
+	{
+		if (auto candidate=commands.find(command); candidate != commands.end())
+		{
+			const quint32 index=candidate->second;
+			if (stale[index])
+			{
+				Assign(index,policy);
+				stale[index]=false;
+			}
+			return index;
+		}
+
+		// first use of this command
+		const quint32 index=static_cast<quint32>(policies.size());
+		commands.emplace(command,index);
+		policies.emplace_back();
+		buckets.emplace_back();
+		stale.push_back(false);
+		Assign(index,policy);
+		return index;
+	}
+
+	void Engine::Assign(quint32 index,const Policy &policy)
+	{
+		policies[index]=policy;
+		if (policy.command.Enabled())
+			buckets[index].emplace(policy.command.uses,policy.command.window);
+		else
+			buckets[index].reset();
+	}
+
+	Engine::State* Engine::Viewer(quint64 key,const Limit &limit,Clock::time_point now)
+	{
+		auto [state,created]=states.try_emplace(key,State{RateLimit::TokenBucket(limit.uses,limit.window),now+limit.window});
+		if (created)
+		{
+			wheel.Schedule(key,limit.window);
+			if (!ticker.isActive()) ticker.start();
+		}
+		return &state->second;
+	}
+
+	void Engine::Take(State &state,const Limit &limit,Clock::time_point now)
+	{
+		state.bucket.Take();
+		state.idle=now+limit.window; // it takes at most a full window for the bucket to fill back up
+	}
+
+	void Engine::Expire(quint64 key)
+	{
+		auto state=states.find(key);
+		if (state == states.end()) return;
+
+		const Clock::time_point now=Clock::now();
+		if (state->second.idle <= now)
+		{
+			states.erase(state);
+			return;
+		}
+
+		// used again since it was scheduled, so check back once it's had time to refill
+		wheel.Schedule(key,std::chrono::ceil<std::chrono::milliseconds>(state->second.idle-now));
+	}
+}
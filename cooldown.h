@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <array>
+#include <limits>
+#include <vector>
+#include <unordered_map>
+#include "globals.h"
+
+namespace Cooldown
+{
+	using Clock=std::chrono::steady_clock;
+
+	struct Limit
+	{
+		double uses { 0 };
+		std::chrono::milliseconds window { 0 };
+		bool Enabled() const { return uses > 0 && window.count() > 0; }
+	};
+
+	struct Policy
+	{
+		Limit command; //! shared by everyone using the command
+		Limit viewer; //! for each viewer on their own
+	};
+
+	enum class Verdict
+	{
+		ALLOWED,
+		THROTTLED, //! the command, or commands in general, are being used too quickly
+		LIMITED //! the viewer has been limited and hasn't waited out their cooldown
+	};
+
+	// Two levels of 64 one-second slots, which covers a little over an hour before
+	// anything needs to be cascaded down. Each key is only ever in one slot.
+	class TimingWheel
+	{
+	public:
+		static constexpr std::size_t SLOTS=64;
+		static constexpr std::chrono::seconds RESOLUTION { 1 };
+		TimingWheel() : tick(0) { }
+		void Schedule(quint64 key,std::chrono::milliseconds delay);
+		template<typename F> void Advance(F &&expire);
+	protected:
+		std::array<std::vector<quint64>,SLOTS> inner;
+		std::array<std::vector<quint64>,SLOTS> outer;
+		std::vector<quint64> scratch;
+		quint64 tick;
+		template<typename F> void Drain(std::vector<quint64> &slot,F &expire);
+	};
+
+	template<typename F> void TimingWheel::Advance(F &&expire)
+	{
+		tick++;
+
+		// bring the next stretch of outer slots down to where they can expire
+		if (tick%SLOTS == 0) Drain(outer[(tick/SLOTS)%SLOTS],expire);
+		Drain(inner[tick%SLOTS],expire);
+	}
+
+	template<typename F> void TimingWheel::Drain(std::vector<quint64> &slot,F &expire)
+	{
+		// swapping through scratch keeps both allocations around for the next time around the wheel
+		scratch.swap(slot);
+		for (quint64 key : scratch) expire(key);
+		scratch.clear();
+	}
+
+	class Engine : public QObject
+	{
+		Q_OBJECT
+	public:
+		Engine(QObject *parent=nullptr);
+		void Global(const Limit &limit);
+		void Limited(const Limit &limit);
+		void Forget(const QString &command);
+		Verdict Check(const QString &command,const Policy &policy,quint32 viewer,bool limited);
+	protected:
+		struct State
+		{
+			RateLimit::TokenBucket bucket;
+			Clock::time_point idle; //! once the bucket has refilled, there's nothing left worth remembering
+		};
+		std::optional<RateLimit::TokenBucket> global;
+		Limit limited;
+		std::unordered_map<QString,quint32> commands; //! command name to a dense index, so per-viewer state can key on numbers
+		std::vector<Policy> policies;
+		std::vector<std::optional<RateLimit::TokenBucket>> buckets;
+		std::vector<bool> stale; //! the command's rules changed since its slot was filled
+		std::unordered_map<quint64,State> states; //! per-viewer buckets, keyed on command index and viewer ID together
+		TimingWheel wheel;
+		QTimer ticker;
+		static constexpr quint32 LIMITED_COMMAND=std::numeric_limits<quint32>::max();
+		quint32 Index(const QString &command,const Policy &policy);
+		void Assign(quint32 index,const Policy &policy);
+		State* Viewer(quint64 key,const Limit &limit,Clock::time_point now);
+		void Take(State &state,const Limit &limit,Clock::time_point now);
+		void Expire(quint64 key);
+	};
+}
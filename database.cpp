@@ -0,0 +1,251 @@
+#include <QSqlError>
+#include "database.h"
+#include "globals.h"
+
+const char *DATABASE_DRIVER="QSQLITE";
+const char *DATABASE_NAME="viewers";
+const char *DATABASE_EXTENSION="sqlite";
+const char *DATABASE_CONNECTION_READ="read";
+const char *DATABASE_CONNECTION_WRITE="write";
+const std::chrono::milliseconds DATABASE_COMMIT_INTERVAL(1000);
+const std::size_t DATABASE_COMMIT_BATCH=512;
+const char *OPERATION_DATABASE_OPEN="open";
+const char *OPERATION_DATABASE_COMMIT="commit";
+
+namespace Database
+{
+	Writer::~Writer()
+	{
+		Commit();
+		statements.clear();
+		database.close();
+		database=QSqlDatabase(); // the connection can't be removed while anything still refers to it
+		QSqlDatabase::removeDatabase(connection);
+	}
+
+	bool Writer::Open(const QString &path)
+	{
+		commitTimer=new QTimer(this);
+		commitTimer->setSingleShot(true);
+		commitTimer->setInterval(DATABASE_COMMIT_INTERVAL);
+		connect(commitTimer,&QTimer::timeout,this,&Writer::Commit);
+
+		database=QSqlDatabase::addDatabase(DATABASE_DRIVER,connection);
+		database.setDatabaseName(path);
+		if (!database.open())
+		{
+			emit Print(QString("Failed to open %1: %2").arg(path,database.lastError().text()),OPERATION_DATABASE_OPEN);
+			return false;
+		}
+
+		// WAL lets the GUI thread read while we write, and NORMAL only syncs at checkpoints,
+		// which is plenty since we'd lose at most the last second of changes either way
+		QSqlQuery query(database);
+		for (const char *statement : {
+			"PRAGMA journal_mode=WAL",
+			"PRAGMA synchronous=NORMAL",
+			"CREATE TABLE IF NOT EXISTS viewers ("
+				"login TEXT PRIMARY KEY NOT NULL,"
+				"flags INTEGER NOT NULL DEFAULT 1,"
+				"first_seen INTEGER,"
+				"last_seen INTEGER,"
+				"messages INTEGER NOT NULL DEFAULT 0,"
+				"commands INTEGER NOT NULL DEFAULT 0,"
+				"followed INTEGER"
+			") WITHOUT ROWID"
+		})
+		{
+			if (!query.exec(statement))
+			{
+				emit Print(QString("Failed to prepare %1: %2").arg(path,query.lastError().text()),OPERATION_DATABASE_OPEN);
+				return false;
+			}
+		}
+
+		for (const auto &[change,statement] : std::initializer_list<std::pair<Change,const char*>>{
+			{Change::FLAGS,"INSERT INTO viewers (login,flags,first_seen,last_seen) VALUES (?,?,?,?) ON CONFLICT(login) DO UPDATE SET flags=excluded.flags"},
+			{Change::SEEN,"INSERT INTO viewers (login,messages,first_seen,last_seen) VALUES (?,?,?,?) ON CONFLICT(login) DO UPDATE SET messages=messages+excluded.messages,last_seen=excluded.last_seen"},
+			{Change::COMMAND,"INSERT INTO viewers (login,commands,first_seen,last_seen) VALUES (?,?,?,?) ON CONFLICT(login) DO UPDATE SET commands=commands+excluded.commands,last_seen=excluded.last_seen"},
+			{Change::FOLLOWED,"INSERT INTO viewers (login,followed,first_seen,last_seen) VALUES (?,?,?,?) ON CONFLICT(login) DO UPDATE SET followed=excluded.followed"},
+			{Change::RESET,"UPDATE viewers SET flags=flags&?"}
+		})
+		{
+			QSqlQuery prepared(database);
+			if (!prepared.prepare(statement))
+			{
+				emit Print(QString("Failed to prepare statement: %1").arg(prepared.lastError().text()),OPERATION_DATABASE_OPEN);
+				return false;
+			}
+			statements.emplace(change,std::move(prepared));
+		}
+
+		return true;
+	}
+
+	void Writer::Queue(const Pending &change)
+	{
+		pending.push_back(change);
+		if (pending.size() >= DATABASE_COMMIT_BATCH)
+			Commit();
+		else if (!commitTimer->isActive())
+			commitTimer->start();
+	}
+
+	void Writer::Commit()
+	{
+		if (commitTimer) commitTimer->stop();
+		if (pending.empty() || !database.isOpen()) return;
+
+		database.transaction();
+		for (const Pending &change : pending)
+		{
+			QSqlQuery &statement=statements.at(change.change);
+			if (change.change == Change::RESET)
+			{
+				statement.bindValue(0,change.value);
+			}
+			else
+			{
+				statement.bindValue(0,change.login);
+				statement.bindValue(1,change.value);
+				statement.bindValue(2,change.timestamp);
+				statement.bindValue(3,change.timestamp);
+			}
+			if (!statement.exec()) emit Print(QString("Failed to record change for %1: %2").arg(change.login,statement.lastError().text()),OPERATION_DATABASE_COMMIT);
+		}
+		if (!database.commit())
+		{
+			emit Print(QString("Failed to commit %1 changes: %2").arg(QString::number(pending.size()),database.lastError().text()),OPERATION_DATABASE_COMMIT);
+			database.rollback();
+		}
+		pending.clear();
+	}
+
+	Viewers::Viewers(const QString &room,QObject *parent) : QObject(parent),
+		name(room.isEmpty() ? QString(DATABASE_NAME) : QString("%1-%2").arg(DATABASE_NAME,QStringView(room).sliced(room.startsWith('#') ? 1 : 0))),
+		writer(new Writer(QString("%1-%2").arg(name,DATABASE_CONNECTION_WRITE)))
+	{
+		writer->moveToThread(&thread);
+		connect(writer,&Writer::Print,this,&Viewers::Print);
+		connect(&thread,&QThread::finished,writer,&QObject::deleteLater);
+		thread.setObjectName("database");
+		thread.start();
+	}
+
+	Viewers::~Viewers()
+	{
+		// the writer commits whatever is left on its way out
+		thread.quit();
+		thread.wait();
+		lookup=QSqlQuery();
+		database.close();
+		database=QSqlDatabase();
+		QSqlDatabase::removeDatabase(QString("%1-%2").arg(name,DATABASE_CONNECTION_READ));
+	}
+
+	bool Viewers::Open()
+	{
+		const QDir path=Filesystem::DataPath();
+		if (!path.mkpath(path.absolutePath())) return false;
+		const QString filename=path.filePath(QString("%1.%2").arg(name,DATABASE_EXTENSION));
+
+		// the writer creates the schema, so it has to be finished before we can look anything up
+		bool opened=false;
+		QMetaObject::invokeMethod(writer,[this,filename]() {
+			return writer->Open(filename);
+		},Qt::BlockingQueuedConnection,&opened);
+		if (!opened) return false;
+
+		database=QSqlDatabase::addDatabase(DATABASE_DRIVER,QString("%1-%2").arg(name,DATABASE_CONNECTION_READ));
+		database.setDatabaseName(filename);
+		database.setConnectOptions("QSQLITE_OPEN_READONLY");
+		if (!database.open())
+		{
+			emit Print(QString("Failed to open %1: %2").arg(filename,database.lastError().text()),OPERATION_DATABASE_OPEN);
+			return false;
+		}
+		lookup=QSqlQuery(database);
+		if (!lookup.prepare("SELECT flags FROM viewers WHERE login=?"))
+		{
+			emit Print(QString("Failed to prepare lookup: %1").arg(lookup.lastError().text()),OPERATION_DATABASE_OPEN);
+			return false;
+		}
+		return true;
+	}
+
+	bool Viewers::Empty()
+	{
+		if (!database.isOpen()) return true;
+		QSqlQuery query("SELECT EXISTS (SELECT 1 FROM viewers)",database);
+		return !query.next() || !query.value(0).toBool();
+	}
+
+	std::optional<quint8> Viewers::Flags(const QString &login)
+	{
+		// one indexed row, so this is fine to do on the GUI thread
+		if (!database.isOpen()) return std::nullopt;
+		lookup.bindValue(0,login);
+		if (!lookup.exec() || !lookup.next())
+		{
+			lookup.finish();
+			return std::nullopt;
+		}
+		const quint8 flags=static_cast<quint8>(lookup.value(0).toUInt());
+		lookup.finish();
+		return flags;
+	}
+
+	void Viewers::Flags(const QString &login,quint8 flags)
+	{
+		Queue(Writer::Change::FLAGS,login,flags);
+	}
+
+	void Viewers::Seen(const QString &login)
+	{
+		Queue(Writer::Change::SEEN,login,1);
+	}
+
+	void Viewers::Command(const QString &login)
+	{
+		Queue(Writer::Change::COMMAND,login,1);
+	}
+
+	void Viewers::Followed(const QString &login,const QDateTime &date)
+	{
+		Queue(Writer::Change::FOLLOWED,login,date.toSecsSinceEpoch());
+	}
+
+	void Viewers::Reset(quint8 mask)
+	{
+		Queue(Writer::Change::RESET,{},mask);
+	}
+
+	void Viewers::Flush()
+	{
+		QMetaObject::invokeMethod(writer,&Writer::Commit,Qt::BlockingQueuedConnection);
+	}
+
+	bool Viewers::Each(const std::function<void(const QString &login,quint8 flags)> &visit)
+	{
+		if (!database.isOpen()) return false;
+		Flush(); // so whatever changed this session is included
+
+		// rows are read one at a time rather than all at once, however many viewers there are
+		QSqlQuery query(database);
+		query.setForwardOnly(true);
+		if (!query.exec("SELECT login,flags FROM viewers ORDER BY login"))
+		{
+			emit Print(QString("Failed to read viewers: %1").arg(query.lastError().text()));
+			return false;
+		}
+		while (query.next()) visit(query.value(0).toString(),static_cast<quint8>(query.value(1).toUInt()));
+		return true;
+	}
+
+	void Viewers::Queue(Writer::Change change,const QString &login,qint64 value)
+	{
+		QMetaObject::invokeMethod(writer,[writer=writer,change=Writer::Pending{change,login,value,QDateTime::currentSecsSinceEpoch()}]() {
+			writer->Queue(change);
+		},Qt::QueuedConnection);
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace Database
+{
+	// Lives on the database thread. Changes pile up here and go out together
+	// in one transaction, so the GUI thread never waits on the disk.
+	class Writer : public QObject
+	{
+		Q_OBJECT
+	public:
+		enum class Change
+		{
+			FLAGS,
+			SEEN,
+			COMMAND,
+			FOLLOWED,
+			RESET
+		};
+		struct Pending
+		{
+			Change change;
+			QString login;
+			qint64 value;
+			qint64 timestamp;
+		};
+		Writer(const QString &connection,QObject *parent=nullptr) : QObject(parent), connection(connection), commitTimer(nullptr) { }
+		~Writer();
+		bool Open(const QString &path);
+		void Queue(const Pending &change);
+	protected:
+		QString connection;
+		QSqlDatabase database;
+		std::vector<Pending> pending;
+		std::unordered_map<Change,QSqlQuery> statements;
+		QTimer *commitTimer;
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("database"));
+	public slots:
+		void Commit();
+	};
+
+	class Viewers : public QObject
+	{
+		Q_OBJECT
+	public:
+		Viewers(const QString &room=QString(),QObject *parent=nullptr);
+		~Viewers();
+		bool Open();
+		bool Empty();
+		std::optional<quint8> Flags(const QString &login);
+		void Flags(const QString &login,quint8 flags);
+		void Seen(const QString &login);
+		void Command(const QString &login);
+		void Followed(const QString &login,const QDateTime &date);
+		void Reset(quint8 mask);
+		void Flush();
+		bool Each(const std::function<void(const QString &login,quint8 flags)> &visit);
+	protected:
+		QString name; //! the channel's own room keeps the original file, any other room gets its own
+		QThread thread;
+		Writer *writer; //! owned by the database thread, so only touch it through invokeMethod()
+		QSqlDatabase database; //! read-only connection for the GUI thread, which WAL lets run alongside the writer
+		QSqlQuery lookup;
+		void Queue(Writer::Change change,const QString &login,qint64 value=0);
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("database"));
+	};
+}
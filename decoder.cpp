@@ -0,0 +1,34 @@
+#include <QBuffer>
+#include <QImageReader>
+#include <QThread>
+#include "decoder.h"
+
+const int DECODER_THREADS=2; // enough to keep a burst moving without competing with the overlay for cores
+
+namespace Decoder
+{
+	QThreadPool& Pool()
+	{
+		// owned by the application, so it's wound down while there's still an application to deliver to
+		static QThreadPool *pool=[]() {
+			QThreadPool *pool=new QThreadPool(qApp);
+			pool->setObjectName("decoder");
+			pool->setMaxThreadCount(std::max(1,std::min(DECODER_THREADS,QThread::idealThreadCount()-1)));
+			return pool;
+		}();
+		return *pool;
+	}
+
+	QImage Read(const QByteArray &data,const QSize &bounds)
+	{
+		QBuffer buffer;
+		buffer.setData(data);
+		buffer.open(QIODevice::ReadOnly);
+		QImageReader reader(&buffer);
+
+		// only ever shrink, and formats that can scale while decoding (like JPEG) never build the full-size image at all
+		if (const QSize size=reader.size(); bounds.isValid() && size.isValid() && (size.width() > bounds.width() || size.height() > bounds.height()))
+			reader.setScaledSize(size.scaled(bounds,Qt::KeepAspectRatio));
+		return reader.read();
+	}
+}
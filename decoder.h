@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QObject>
+#include <QImage>
+#include <QThreadPool>
+#include <QPointer>
+#include <QCoreApplication>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace Decoder
+{
+	inline const QSize PANE_BOUNDS(1024,1024); //! nothing in an announcement pane is ever shown bigger than this
+
+	QThreadPool& Pool();
+	QImage Read(const QByteArray &data,const QSize &bounds=QSize());
+
+	// Does the work on the decoder's own threads and hands the result back on the GUI thread.
+	// If context goes away first, the work is skipped if it hasn't started and the result is dropped if it has.
+	template<typename T> void Run(QObject *context,std::function<T()> work,std::function<void(const T&)> deliver)
+	{
+		struct Job
+		{
+			std::atomic<bool> cancelled { false };
+			QMetaObject::Connection watch;
+		};
+		std::shared_ptr<Job> job=std::make_shared<Job>();
+		job->watch=QObject::connect(context,&QObject::destroyed,[job]() {
+			job->cancelled=true;
+		});
+		Pool().start([job,context=QPointer<QObject>(context),work,deliver]() {
+			if (job->cancelled) return;
+			const T result=work();
+			QMetaObject::invokeMethod(qApp,[job,context,deliver,result]() {
+				QObject::disconnect(job->watch);
+				if (context) deliver(result);
+			},Qt::QueuedConnection);
+		});
+	}
+
+	inline void Image(const QByteArray &data,QObject *context,std::function<void(const QImage&)> deliver,const QSize &bounds=QSize())
+	{
+		Run<QImage>(context,[data,bounds]() {
+			return Read(data,bounds);
+		},deliver);
+	}
+}
@@ -0,0 +1,346 @@
+#include <QFile>
+#include <QJsonObject>
+#include <QImageReader>
+#include <QSet>
+#include <algorithm>
+#include <limits>
+#include "emotes.h"
+#include "network.h"
+#include "decoder.h"
+#include "globals.h"
+
+const char *EMOTES_LOCAL_FILENAME="emotes.json";
+const std::chrono::milliseconds EMOTES_REBUILD_DELAY(250);
+const char *SETTINGS_CATEGORY_EMOTES="Emotes";
+const char *OPERATION_EMOTES_LOAD="load emote set";
+const qsizetype EMOTES_LOCAL_SET=std::numeric_limits<qsizetype>::max();
+
+namespace Emotes
+{
+	Automaton::Automaton(const Entries &candidates)
+	{
+		// build the trie with maps first, since we don't know how many edges each state will end up with,
+		// then pack everything into flat arrays once the shape is settled
+		std::vector<std::map<char16_t,qint32>> children(1);
+		states.emplace_back();
+		entries.reserve(candidates.size());
+		for (const Entry &candidate : candidates)
+		{
+			if (candidate.name.isEmpty()) continue;
+			qint32 state=0;
+			for (QChar character : candidate.name)
+			{
+				auto [child,created]=children[state].try_emplace(character.unicode(),static_cast<qint32>(states.size()));
+				const qint32 next=child->second;
+				if (created)
+				{
+					states.emplace_back();
+					children.emplace_back();
+				}
+				state=next;
+			}
+			if (states[state].output >= 0)
+			{
+				entries[states[state].output]=candidate; // same name from a later set replaces the earlier one
+				continue;
+			}
+			states[state].output=static_cast<qint32>(entries.size());
+			entries.push_back(candidate);
+		}
+
+		// breadth first, so every state's fail link points somewhere shallower that's already been worked out
+		std::vector<qint32> order;
+		order.reserve(states.size());
+		for (const auto &[label,child] : children[0]) order.push_back(child);
+		for (std::size_t index=0; index < order.size(); index++)
+		{
+			const qint32 parent=order[index];
+			for (const auto &[label,child] : children[parent])
+			{
+				qint32 fallback=states[parent].fail;
+				while (fallback > 0 && !children[fallback].contains(label)) fallback=states[fallback].fail;
+				auto candidate=children[fallback].find(label);
+				State &state=states[child];
+				state.fail=candidate == children[fallback].end() ? 0 : candidate->second;
+				state.link=states[state.fail].output >= 0 ? state.fail : states[state.fail].link;
+				order.push_back(child);
+			}
+		}
+
+		edges.reserve(states.size()-1);
+		for (std::size_t index=0; index < states.size(); index++)
+		{
+			states[index].first=static_cast<quint32>(edges.size());
+			states[index].count=static_cast<quint32>(children[index].size());
+			for (const auto &[label,child] : children[index]) edges.push_back({label,child});
+		}
+	}
+
+	qint32 Automaton::Step(qint32 state,char16_t character) const
+	{
+		for (;;)
+		{
+			if (const qint32 next=Child(states[state],character); next >= 0) return next;
+			if (state == 0) return 0;
+			state=states[state].fail;
+		}
+	}
+
+	qint32 Automaton::Child(const State &state,char16_t character) const
+	{
+		const auto begin=edges.begin()+state.first;
+		const auto end=begin+state.count;
+		const auto edge=std::lower_bound(begin,end,character,[](const Edge &edge,char16_t character) {
+			return edge.label < character;
+		});
+		return edge != end && edge->label == character ? edge->target : -1;
+	}
+
+	Provider::Provider(QObject *parent) : QObject(parent),
+		generation(0),
+		settingSources(SETTINGS_CATEGORY_EMOTES,"Sources",QStringList{
+			"https://api.betterttv.net/3/cached/emotes/global",
+			"https://api.betterttv.net/3/cached/users/twitch/%1",
+			"https://api.frankerfacez.com/v1/set/global",
+			"https://api.frankerfacez.com/v1/room/id/%1",
+			"https://7tv.io/v3/emote-sets/global",
+			"https://7tv.io/v3/users/twitch/%1"
+		})
+	{
+		rebuild.setSingleShot(true);
+		rebuild.setInterval(EMOTES_REBUILD_DELAY);
+		connect(&rebuild,&QTimer::timeout,this,&Provider::Rebuild);
+
+		localReload.setSingleShot(true);
+		localReload.setInterval(EMOTES_REBUILD_DELAY);
+		connect(&localReload,&QTimer::timeout,this,&Provider::LoadLocal);
+		connect(&localWatcher,&QFileSystemWatcher::fileChanged,&localReload,QOverload<>::of(&QTimer::start));
+		connect(&localWatcher,&QFileSystemWatcher::directoryChanged,this,[this]() {
+			if (const QString path=Filesystem::DataPath().filePath(EMOTES_LOCAL_FILENAME); QFile::exists(path) && !localWatcher.files().contains(path)) localReload.start();
+		});
+	}
+
+	void Provider::Load(const QString &channelID)
+	{
+		LoadLocal();
+
+		// sources that are specific to a channel have a %1 where the channel's ID goes
+		const QStringList sources=settingSources;
+		for (qsizetype index=0; index < sources.size(); index++)
+		{
+			const QString source=sources.at(index).contains("%1") ? sources.at(index).arg(channelID) : sources.at(index);
+			Network::Request::Send({source},Network::Method::GET,[this,index,source](QNetworkReply *reply) {
+				if (reply->error())
+				{
+					emit Print(QString("Failed to download %1: %2").arg(source,reply->errorString()),OPERATION_EMOTES_LOAD);
+					return;
+				}
+
+				const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
+				if (!parsedJSON)
+				{
+					emit Print(QString("Failed to parse %1: %2").arg(source,parsedJSON.error),OPERATION_EMOTES_LOAD);
+					return;
+				}
+
+				sets[index]=Parse(parsedJSON());
+				rebuild.start();
+			});
+		}
+	}
+
+	void Provider::LoadLocal()
+	{
+		// A plain object of names to image URLs, for emotes that don't come from
+		// any of the services, or to stand in for them entirely when testing.
+		QFile file(Filesystem::DataPath().filePath(EMOTES_LOCAL_FILENAME));
+		if (localWatcher.directories().isEmpty()) localWatcher.addPath(Filesystem::DataPath().absolutePath());
+		if (!file.exists())
+		{
+			if (sets.erase(EMOTES_LOCAL_SET) > 0) rebuild.start();
+			return;
+		}
+		if (!localWatcher.files().contains(file.fileName())) localWatcher.addPath(file.fileName());
+
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			emit Print(QString("Failed to open %1: %2").arg(file.fileName(),file.errorString()),OPERATION_EMOTES_LOAD);
+			return;
+		}
+
+		const JSON::ParseResult parsedJSON=JSON::Parse(file.readAll());
+		if (!parsedJSON)
+		{
+			emit Print(QString("Failed to parse %1: %2").arg(file.fileName(),parsedJSON.error),OPERATION_EMOTES_LOAD);
+			return; // keep whatever we had until the file is fixed
+		}
+
+		Entries entries;
+		const QJsonObject object=parsedJSON().object();
+		entries.reserve(object.size());
+		for (auto entry=object.begin(); entry != object.end(); entry++) entries.push_back({entry.key(),entry.value().toString()});
+		sets[EMOTES_LOCAL_SET]=std::move(entries);
+		rebuild.start();
+	}
+
+	void Provider::Rebuild()
+	{
+		Entries entries;
+		for (const auto &[source,set] : sets) entries.insert(entries.end(),set.begin(),set.end());
+
+		// thousands of names take long enough to build that it's worth keeping off the GUI thread,
+		// and chat keeps matching against the old automaton until the new one is ready
+		const quint64 current=++generation;
+		Decoder::Run<std::shared_ptr<const Automaton>>(this,[entries=std::move(entries)]() {
+			return std::make_shared<const Automaton>(entries);
+		},[this,current](const std::shared_ptr<const Automaton> &built) {
+			if (current != generation) return; // something changed while this was building and a newer one is on its way
+			automaton=built;
+		});
+	}
+
+	void Provider::Match(QStringView text,Chat::EmoteList &emotes) const
+	{
+		if (!automaton) return;
+
+		// Twitch's own ranges are already sorted, and so are the matches since they come
+		// out in the order they appear, so we can step through both together
+		const std::size_t native=emotes.size();
+		std::size_t next=0;
+		automaton->Scan(text,[&emotes,native,&next](int start,int end,const Entry &entry) {
+			while (next < native && emotes[next].end < start) next++;
+			if (next < native && emotes[next].start <= end) return; // Twitch already claimed this word
+			emotes.push_back(Chat::Emote{
+				.name=entry.name,
+				.url=entry.url,
+				.start=start,
+				.end=end
+			});
+		});
+		std::inplace_merge(emotes.begin(),emotes.begin()+native,emotes.end());
+	}
+
+	Entries Provider::Parse(const QJsonDocument &json)
+	{
+		static const char *JSON_KEY_BTTV_CHANNEL="channelEmotes";
+		static const char *JSON_KEY_BTTV_SHARED="sharedEmotes";
+		static const char *JSON_KEY_FFZ_SETS="sets";
+		static const char *JSON_KEY_FFZ_DEFAULT_SETS="default_sets";
+		static const char *JSON_KEY_7TV_SET="emote_set";
+		static const char *JSON_KEY_7TV_EMOTES="emotes";
+
+		// none of the services label their responses, so tell them apart by shape
+		if (json.isArray()) return ParseBTTV(json.array()); // BetterTTV's global set
+		const QJsonObject object=json.object();
+		if (object.contains(JSON_KEY_BTTV_CHANNEL) || object.contains(JSON_KEY_BTTV_SHARED))
+		{
+			Entries entries=ParseBTTV(object.value(JSON_KEY_BTTV_CHANNEL).toArray());
+			const Entries shared=ParseBTTV(object.value(JSON_KEY_BTTV_SHARED).toArray());
+			entries.insert(entries.end(),shared.begin(),shared.end());
+			return entries;
+		}
+		if (object.contains(JSON_KEY_FFZ_SETS)) return ParseFFZ(object.value(JSON_KEY_FFZ_SETS).toObject(),object.value(JSON_KEY_FFZ_DEFAULT_SETS).toArray());
+		if (object.contains(JSON_KEY_7TV_SET)) return Parse7TV(object.value(JSON_KEY_7TV_SET).toObject().value(JSON_KEY_7TV_EMOTES).toArray()); // a channel's set comes wrapped in the user lookup
+		if (object.contains(JSON_KEY_7TV_EMOTES)) return Parse7TV(object.value(JSON_KEY_7TV_EMOTES).toArray());
+		return {};
+	}
+
+	Entries Provider::ParseBTTV(const QJsonArray &emotes)
+	{
+		static const char *JSON_KEY_ID="id";
+		static const char *JSON_KEY_CODE="code";
+		static const char *URL_TEMPLATE="https://cdn.betterttv.net/emote/%1/1x";
+
+		Entries entries;
+		entries.reserve(emotes.size());
+		for (const QJsonValue &value : emotes)
+		{
+			const QJsonObject emote=value.toObject();
+			const QString id=emote.value(JSON_KEY_ID).toString();
+			const QString name=emote.value(JSON_KEY_CODE).toString();
+			if (id.isEmpty() || name.isEmpty()) continue;
+			entries.push_back({name,QString(URL_TEMPLATE).arg(id)});
+		}
+		return entries;
+	}
+
+	Entries Provider::ParseFFZ(const QJsonObject &sets,const QJsonArray &defaults)
+	{
+		static const char *JSON_KEY_EMOTICONS="emoticons";
+		static const char *JSON_KEY_NAME="name";
+		static const char *JSON_KEY_URLS="urls";
+		static const char *JSON_KEY_SMALLEST="1";
+
+		// the global response also carries sets that are only handed out to some users,
+		// and lists the ones everyone gets separately (a channel's response has no such list)
+		QSet<QString> everyone;
+		for (const QJsonValue &set : defaults) everyone.insert(QString::number(set.toInteger()));
+
+		Entries entries;
+		for (QJsonObject::const_iterator set=sets.begin(); set != sets.end(); ++set)
+		{
+			if (!everyone.isEmpty() && !everyone.contains(set.key())) continue;
+			const QJsonArray emoticons=set->toObject().value(JSON_KEY_EMOTICONS).toArray();
+			entries.reserve(entries.size()+emoticons.size());
+			for (const QJsonValue &value : emoticons)
+			{
+				const QJsonObject emote=value.toObject();
+				const QString name=emote.value(JSON_KEY_NAME).toString();
+				QString url=emote.value(JSON_KEY_URLS).toObject().value(JSON_KEY_SMALLEST).toString();
+				if (name.isEmpty() || url.isEmpty()) continue;
+				if (url.startsWith("//")) url.prepend("https:"); // older sets leave off the scheme
+				entries.push_back({name,url});
+			}
+		}
+		return entries;
+	}
+
+	Entries Provider::Parse7TV(const QJsonArray &emotes)
+	{
+		static const char *JSON_KEY_NAME="name";
+		static const char *JSON_KEY_DATA="data";
+		static const char *JSON_KEY_HOST="host";
+		static const char *JSON_KEY_URL="url";
+		static const char *JSON_KEY_FILES="files";
+		static const char *URL_TEMPLATE="https:%1/%2";
+		static const char *SMALLEST="1x.";
+
+		// 7TV serves every size in several formats, but WebP needs an image plugin that isn't
+		// always installed, so take the first one we can actually decode, best looking first
+		static const std::vector<QByteArray> formats=[]() {
+			const QList<QByteArray> supported=QImageReader::supportedImageFormats();
+			std::vector<QByteArray> formats;
+			for (const char *format : {"webp","gif","png"})
+			{
+				if (supported.contains(format)) formats.emplace_back(format);
+			}
+			return formats;
+		}();
+
+		Entries entries;
+		entries.reserve(emotes.size());
+		for (const QJsonValue &value : emotes)
+		{
+			const QJsonObject emote=value.toObject();
+			const QString name=emote.value(JSON_KEY_NAME).toString();
+			const QJsonObject host=emote.value(JSON_KEY_DATA).toObject().value(JSON_KEY_HOST).toObject();
+			const QString url=host.value(JSON_KEY_URL).toString();
+			if (name.isEmpty() || url.isEmpty()) continue;
+
+			// not every emote has every format, so check what this one lists, and settle for PNG if it doesn't say
+			QSet<QString> files;
+			for (const QJsonValue &file : host.value(JSON_KEY_FILES).toArray()) files.insert(file.toObject().value(JSON_KEY_NAME).toString());
+			QString filename=QString(SMALLEST)+"png";
+			for (const QByteArray &format : formats)
+			{
+				if (const QString candidate=QString(SMALLEST)+QString::fromLatin1(format); files.contains(candidate))
+				{
+					filename=candidate;
+					break;
+				}
+			}
+			entries.push_back({name,QString(URL_TEMPLATE).arg(url,filename)});
+		}
+		return entries;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QFileSystemWatcher>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <map>
+#include <memory>
+#include <vector>
+#include "entities.h"
+
+namespace Emotes
+{
+	struct Entry
+	{
+		QString name;
+		QString url;
+	};
+	using Entries=std::vector<Entry>;
+
+	// Aho-Corasick over UTF-16 code units, so the offsets it finds line up with
+	// QString indices just like the ranges Twitch gives us for its own emotes.
+	// Built once and never touched again, which is what lets it be built on a
+	// worker thread and handed over whole.
+	class Automaton
+	{
+	public:
+		Automaton(const Entries &candidates);
+		template<typename F> void Scan(QStringView text,F &&found) const;
+		std::size_t Size() const { return entries.size(); }
+	protected:
+		struct Edge
+		{
+			char16_t label;
+			qint32 target;
+		};
+		struct State
+		{
+			quint32 first { 0 }; //! edges are stored together, sorted by label, starting here
+			quint32 count { 0 };
+			qint32 fail { 0 };
+			qint32 output { -1 }; //! entry that ends exactly at this state
+			qint32 link { -1 }; //! next state along the fail chain that has an output
+		};
+		std::vector<State> states;
+		std::vector<Edge> edges;
+		Entries entries;
+		qint32 Step(qint32 state,char16_t character) const;
+		qint32 Child(const State &state,char16_t character) const;
+		static bool Boundary(QStringView text,qsizetype index) { return index < 0 || index >= text.size() || text.at(index).isSpace(); }
+	};
+
+	template<typename F> void Automaton::Scan(QStringView text,F &&found) const
+	{
+		qint32 state=0;
+		for (qsizetype index=0; index < text.size(); index++)
+		{
+			state=Step(state,text.at(index).unicode());
+
+			// emotes are whole words, so there's only anything to report where one ends
+			if (!Boundary(text,index+1)) continue;
+			for (qint32 candidate=states[state].output >= 0 ? state : states[state].link; candidate >= 0; candidate=states[candidate].link)
+			{
+				const Entry &entry=entries[states[candidate].output];
+				const qsizetype start=index+1-entry.name.size();
+				if (!Boundary(text,start-1)) continue;
+				found(static_cast<int>(start),static_cast<int>(index),entry);
+				break; // names can't contain spaces, so nothing shorter can start on a boundary too
+			}
+		}
+	}
+
+	// Third-party emote sets (BetterTTV, FrankerFaceZ, 7TV) arrive as lists of
+	// words rather than as ranges in the message tags, so they have to be found
+	// in the text itself.
+	class Provider : public QObject
+	{
+		Q_OBJECT
+	public:
+		Provider(QObject *parent=nullptr);
+		void Load(const QString &channelID);
+		void Match(QStringView text,Chat::EmoteList &emotes) const;
+	protected:
+		std::map<qsizetype,Entries> sets; //! keyed on where the source is listed, so later sources (and the local file last of all) win any name they share
+		std::shared_ptr<const Automaton> automaton;
+		quint64 generation;
+		QTimer rebuild; //! sources tend to arrive together, so build once after they settle
+		QFileSystemWatcher localWatcher;
+		QTimer localReload;
+		ApplicationSetting settingSources;
+		void LoadLocal();
+		void Rebuild();
+		static Entries Parse(const QJsonDocument &json);
+		static Entries ParseBTTV(const QJsonArray &emotes);
+		static Entries ParseFFZ(const QJsonObject &sets,const QJsonArray &defaults);
+		static Entries Parse7TV(const QJsonArray &emotes);
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("emotes"));
+	};
+}
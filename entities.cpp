@@ -1,17 +1,36 @@
 #include <QFileInfo>
+#include <QSaveFile>
 #include <QDir>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <algorithm>
+#include <bit>
 #include <cstring>
 #include "entities.h"
 #include "globals.h"
 #include "network.h"
+#include "decoder.h"
 #include "twitch.h"
 
 Q_DECLARE_METATYPE(std::chrono::milliseconds)
 
-Command::Command(const QString &name,Command* const parent) : name(name), description(parent->description), type(parent->type), random(parent->random), duplicates(parent->duplicates), protect(parent->protect), path(parent->path), files(parent->files), message(parent->message), parent(parent)
+const char *VIEWER_CACHE_FILENAME="profiles.json";
+const char *JSON_KEY_VIEWER_LOGIN="login";
+const char *JSON_KEY_VIEWER_ID="id";
+const char *JSON_KEY_VIEWER_DISPLAY_NAME="display_name";
+const char *JSON_KEY_VIEWER_PROFILE_IMAGE_URL="profile_image_url";
+const char *JSON_KEY_VIEWER_DESCRIPTION="description";
+const char *JSON_KEY_VIEWER_FETCHED="fetched";
+const std::chrono::milliseconds VIEWER_CACHE_LIFETIME=std::chrono::hours(1);
+const std::size_t VIEWER_CACHE_CAPACITY=2048;
+const std::size_t VIEWER_BATCH_CAPACITY=100;
+const std::chrono::milliseconds VIEWER_BATCH_WINDOW(50);
+const std::chrono::milliseconds VIEWER_PREFETCH_WINDOW(1000);
+const qsizetype VIEWER_LOGIN_MAXIMUM_LENGTH=25;
+const char *OPERATION_VIEWER_REQUEST="request viewer information";
+const std::size_t VIEWER_STORE_MINIMUM_SLOTS=64;
+
+Command::Command(const QString &name,Command* const parent) : name(name), description(parent->description), type(parent->type), random(parent->random), duplicates(parent->duplicates), protect(parent->protect), path(parent->path), filters(parent->filters), files(parent->files), message(parent->message), limits(parent->limits), parent(parent)
 {
 	parent->children.push_back(this);
 }
@@ -24,8 +43,29 @@ QStringList Command::FileListFilters(const CommandType type)
 	return filters;
 }
 
+bool Command::Equivalent(const Command &other) const
+{
+	// everything that comes from the commands file, which is everything but the files themselves
+	return name == other.name &&
+		description == other.description &&
+		type == other.type &&
+		random == other.random &&
+		duplicates == other.duplicates &&
+		protect == other.protect &&
+		path == other.path &&
+		message == other.message &&
+		viewers == other.viewers &&
+		limits.command.uses == other.limits.command.uses &&
+		limits.command.window == other.limits.command.window &&
+		limits.viewer.uses == other.limits.viewer.uses &&
+		limits.viewer.window == other.limits.viewer.window;
+}
+
 const QString Command::File()
 {
+	// directories are only read the first time the command is used, so loading
+	// or editing commands never has to walk every media directory up front
+	if ((*files)().isEmpty()) *files=File::List(path,filters);
 	if (random)
 	{
 		if (duplicates)
@@ -213,30 +253,34 @@ namespace Music
 		}
 	}
 
-	Metadata Player::Metadata() const
+	void Player::Metadata(std::function<void(const struct Metadata&)> deliver)
 	{
-		try
-		{
-			ID3::Tag tag(Filename());
-			auto title=tag.Title();
-			auto album=tag.AlbumTitle();
-			auto artist=tag.Artist();
-			auto cover=tag.AlbumCoverFront();
-			return {
-				.title=title ? *title : QString{},
-				.album=album ? *album : QString{},
-				.artist=artist ? *artist : QString{},
-				.cover=cover ? *cover : QImage{},
-				.valid=true
-			};
-		}
-
-		catch (const std::runtime_error &exception)
-		{
-			emit Print(exception.what());
-		}
+		// reading the tags means reading the file and decoding the cover art, so that all happens on the decoder's threads
+		Decoder::Run<struct Metadata>(this,[filename=Filename()]() -> struct Metadata {
+			try
+			{
+				ID3::Tag tag(filename);
+				auto title=tag.Title();
+				auto album=tag.AlbumTitle();
+				auto artist=tag.Artist();
+				auto cover=tag.AlbumCoverFront();
+				return {
+					.title=title ? *title : QString{},
+					.album=album ? *album : QString{},
+					.artist=artist ? *artist : QString{},
+					.cover=cover ? *cover : QImage{},
+					.valid=true
+				};
+			}
 
-		return {};
+			catch (const std::runtime_error &exception)
+			{
+				return {.error=exception.what()};
+			}
+		},[this,deliver](const struct Metadata &metadata) {
+			if (!metadata.error.isEmpty()) emit Print(metadata.error);
+			deliver(metadata);
+		});
 	}
 
 	QString Player::Filename() const
@@ -365,12 +409,12 @@ namespace Music
 
 		Tag::Tag(const QString &filename) : APIC(nullptr)
 		{
-			static const std::unordered_map<QString,Frame::Frame> FRAMES={
+			static constexpr Keyword::Table<Frame::Frame,4> FRAMES({
 				{"APIC",Frame::Frame::APIC},
 				{"TIT2",Frame::Frame::TIT2},
 				{"TALB",Frame::Frame::TALB},
 				{"TPE1",Frame::Frame::TPE1}
-			};
+			});
 
 			try
 			{
@@ -381,14 +425,14 @@ namespace Music
 				{
 					Frame::Header frameHeader(file);
 
-					auto headerID=FRAMES.find(frameHeader.ID());
-					if (headerID == FRAMES.end())
+					std::optional<Frame::Frame> headerID=FRAMES.Find(QByteArrayView(frameHeader.ID()));
+					if (!headerID)
 					{
 						file.skip(frameHeader.Size());
 						continue;
 					}
 
-					switch (headerID->second)
+					switch (*headerID)
 					{
 					case Frame::Frame::APIC:
 						APIC=std::make_unique<Frame::APIC>(file,frameHeader.Size());
@@ -595,11 +639,13 @@ namespace Music
 				quint32 length=DataSize();
 				QByteArray data=file.read(length);
 				if (data.size() < length) throw std::runtime_error("Invalid image data in frame of mp3 file");
-				picture=QImage::fromData(data);
+				pictureData=data;
 			}
 
 			const QImage& APIC::Picture() const
 			{
+				// most readers only want the title, so only decode the cover for the ones that show it
+				if (picture.isNull() && !pictureData.isEmpty()) picture=Decoder::Read(pictureData,Decoder::PANE_BOUNDS);
 				return picture;
 			}
 
@@ -653,15 +699,17 @@ namespace Viewer
 {
 	namespace ProfileImage
 	{
-		Remote::Remote(const QUrl &profileImageURL)
+		Remote::Remote(const QUrl &profileImageURL,QObject *requester) : QObject(requester)
 		{
-			Network::Request::Send(profileImageURL,Network::Method::GET,[this](QNetworkReply *reply) {
-				if (reply->error())
-					emit Print(QString("Failed: %1").arg(reply->errorString()),"profile image retrieval");
+			// whoever asked for the image is the one that decides whether it's still wanted, so if
+			// they go away first, the download and decode are dropped and we go along with them
+			Network::Cache::Image(profileImageURL,requester,[this](const QImage &image,const QString &error) {
+				if (!error.isEmpty())
+					emit Print(QString("Failed: %1").arg(error),"profile image retrieval");
 				else
-					emit Retrieved(std::make_shared<QImage>(QImage::fromData(reply->readAll())));
+					emit Retrieved(std::make_shared<QImage>(image));
 				this->deleteLater();
-			});
+			},Decoder::PANE_BOUNDS);
 		}
 
 		Remote::operator QImage() const
@@ -685,9 +733,14 @@ namespace Viewer
 		return displayName;
 	}
 
-	ProfileImage::Remote* Local::ProfileImage() const
+	ProfileImage::Remote* Local::ProfileImage(QObject *requester) const
 	{
-		return new ProfileImage::Remote(profileImageURL);
+		return new ProfileImage::Remote(profileImageURL,requester);
+	}
+
+	const QUrl& Local::ProfileImageURL() const
+	{
+		return profileImageURL;
 	}
 
 	const QString& Local::Description() const
@@ -695,17 +748,118 @@ namespace Viewer
 		return description;
 	}
 
-	Remote::Remote(Security &security,const QString &username) : name(username)
+	Cache::Cache(Security &security,QObject *parent) : QObject(parent),
+		security(security),
+		batches(0),
+		batchedLogins(0)
+	{
+		batchTimer.setSingleShot(true);
+		batchTimer.setInterval(VIEWER_BATCH_WINDOW);
+		connect(&batchTimer,&QTimer::timeout,this,&Cache::Dispatch);
+	}
+
+	Cache::~Cache()
+	{
+		Save();
+	}
+
+	std::optional<Local> Cache::Find(const QString &login)
+	{
+		auto candidate=entries.find(login);
+		if (candidate == entries.end()) return std::nullopt;
+		if (TimeConvert::Now()-candidate->second.fetched > VIEWER_CACHE_LIFETIME)
+		{
+			recent.erase(candidate->second.recency);
+			entries.erase(candidate);
+			return std::nullopt;
+		}
+		recent.splice(recent.begin(),recent,candidate->second.recency);
+		return candidate->second.viewer;
+	}
+
+	void Cache::Request(const QString &login,bool speculative)
 	{
-		Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_USERS)},Network::Method::GET,[this](QNetworkReply* reply) {
-			const char *OPERATION="request viewer information";
+		// Helix turns away the whole batch over one malformed login, so don't let one into it
+		if (!ValidLogin(login))
+		{
+			emit Print(QString("Not a valid login: %1").arg(login),OPERATION_VIEWER_REQUEST);
+			QMetaObject::invokeMethod(this,[this,login]() {
+				emit Failed(login);
+			},Qt::QueuedConnection); // callers connect after asking, the same as when it goes out to Twitch
+			return;
+		}
+
+		// only the first request for a login goes out, everyone else waits on Resolved or Failed
+		if (!pending.try_emplace(login,std::chrono::steady_clock::now()).second)
+		{
+			// somebody is actually waiting on it now, so don't leave it sitting with the prefetches
+			if (!speculative && batchTimer.isActive() && batchTimer.remainingTime() > VIEWER_BATCH_WINDOW.count()) batchTimer.start(VIEWER_BATCH_WINDOW);
+			return;
+		}
 
+		// Helix takes up to 100 logins at once, so hold on to requests briefly in case more show up
+		// (prefetches can afford to wait a lot longer, since nobody is looking at them yet)
+		(speculative ? prefetches : queued).push_back(login);
+		const std::chrono::milliseconds window=speculative ? VIEWER_PREFETCH_WINDOW : VIEWER_BATCH_WINDOW;
+		if (queued.size()+prefetches.size() >= VIEWER_BATCH_CAPACITY)
+			Dispatch();
+		else if (!batchTimer.isActive() || batchTimer.remainingTime() > window.count())
+			batchTimer.start(window);
+	}
+
+	void Cache::Dispatch()
+	{
+		batchTimer.stop();
+		while (!queued.empty() || !prefetches.empty())
+		{
+			const std::size_t count=std::min(queued.size()+prefetches.size(),VIEWER_BATCH_CAPACITY);
+			QStringList logins;
+			std::chrono::milliseconds longestWait(0);
+			const std::chrono::steady_clock::time_point now=std::chrono::steady_clock::now();
+			for (std::size_t index=0; index < count; index++)
+			{
+				// real requests get the seats first, prefetches fill in whatever's left
+				std::deque<QString> &source=queued.empty() ? prefetches : queued;
+				const QString login=source.front();
+				if (auto requested=pending.find(login); requested != pending.end()) longestWait=std::max(longestWait,std::chrono::duration_cast<std::chrono::milliseconds>(now-requested->second));
+				logins.append(login);
+				source.pop_front();
+			}
+
+			batches++;
+			batchedLogins+=count;
+			emit Print(QString("Requesting %1 viewers in one call (batch %2% full, oldest waited %3ms, %4% full on average)").arg(
+				QString::number(count),
+				QString::number(100*count/VIEWER_BATCH_CAPACITY),
+				QString::number(longestWait.count()),
+				QString::number(100*batchedLogins/(batches*VIEWER_BATCH_CAPACITY))
+			),OPERATION_VIEWER_REQUEST);
+			Send(logins);
+		}
+	}
+
+	void Cache::Send(const QStringList &logins)
+	{
+		QUrlQuery query;
+		for (const QString &login : logins) query.addQueryItem(JSON_KEY_VIEWER_LOGIN,login);
+
+		Network::Request::Send({Twitch::Endpoint(Twitch::ENDPOINT_USERS)},Network::Method::GET,[this,logins](QNetworkReply* reply) {
 			try
 			{
 				switch (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt())
 				{
 				case 400:
-					throw std::runtime_error("Invalid or missing ID or login parameter");
+					// one bad login spoils the batch, so split it in half until the bad one is on its own,
+					// rather than failing everyone else who happened to be asked for alongside it
+					if (logins.size() > 1)
+					{
+						const qsizetype half=logins.size()/2;
+						emit Print(QString("Batch of %1 viewers was rejected, retrying as two batches").arg(QString::number(logins.size())),OPERATION_VIEWER_REQUEST);
+						Send(logins.first(half));
+						Send(logins.sliced(half));
+						return;
+					}
+					throw std::runtime_error(QString("Invalid or missing ID or login parameter (%1)").arg(logins.join(',')).toStdString());
 				case 401:
 					throw std::runtime_error("Authentication failed");
 				}
@@ -714,26 +868,318 @@ namespace Viewer
 
 				const JSON::ParseResult parsedJSON=JSON::Parse(reply->readAll());
 				if (!parsedJSON) throw std::runtime_error(std::string("Failed: "+parsedJSON.error.toStdString()));
-				QJsonArray data=parsedJSON().object().value("data").toArray();
-				if (data.size() < 1) throw std::runtime_error("Invalid user");
-				QJsonObject details=data.at(0).toObject();
-				emit Recognized({details.value("login").toString(),details.value("id").toString(),details.value("display_name").toString(),details.value("profile_image_url").toString(),details.value("description").toString()});
+				const QJsonArray data=parsedJSON().object().value(JSON::Keys::DATA).toArray();
+				for (const QJsonValue &value : data)
+				{
+					const QJsonObject details=value.toObject();
+					Resolve(details.value(JSON_KEY_VIEWER_LOGIN).toString(),{details.value(JSON_KEY_VIEWER_LOGIN).toString(),details.value(JSON_KEY_VIEWER_ID).toString(),details.value(JSON_KEY_VIEWER_DISPLAY_NAME).toString(),details.value(JSON_KEY_VIEWER_PROFILE_IMAGE_URL).toString(),details.value(JSON_KEY_VIEWER_DESCRIPTION).toString()});
+				}
+
+				// Helix silently leaves out logins that don't exist
+				for (const QString &login : logins)
+				{
+					if (pending.contains(login)) Fail(login);
+				}
 			}
 
 			catch (const std::runtime_error &exception)
 			{
-				emit Print(exception.what(),OPERATION);
-				emit Unrecognized();
+				emit Print(exception.what(),OPERATION_VIEWER_REQUEST);
+				for (const QString &login : logins) Fail(login);
 			}
-
-			this->deleteLater();
-		},{
-			{"login",username}
-		},{
+		},query,{
 			{"Authorization",StringConvert::ByteArray(QString("Bearer %1").arg(static_cast<QString>(security.OAuthToken())))},
 			{"Client-ID",security.ClientID()}
 		});
-	};
+	}
+
+	bool Cache::ValidLogin(QStringView login)
+	{
+		// Twitch logins are letters, digits, and underscores, and never longer than 25 of them
+		if (login.isEmpty() || login.size() > VIEWER_LOGIN_MAXIMUM_LENGTH) return false;
+		return std::all_of(login.begin(),login.end(),[](QChar character) {
+			return (character >= u'a' && character <= u'z') || (character >= u'A' && character <= u'Z') || (character >= u'0' && character <= u'9') || character == u'_';
+		});
+	}
+
+	void Cache::Resolve(const QString &login,const Local &viewer)
+	{
+		Store(viewer,TimeConvert::Now());
+		pending.erase(login);
+		emit Resolved(login,viewer);
+	}
+
+	void Cache::Fail(const QString &login)
+	{
+		pending.erase(login);
+		emit Failed(login);
+	}
+
+	void Cache::Store(const Local &viewer,std::chrono::milliseconds fetched)
+	{
+		if (auto existing=entries.find(viewer.Name()); existing != entries.end())
+		{
+			recent.erase(existing->second.recency);
+			entries.erase(existing);
+		}
+		recent.push_front(viewer.Name());
+		entries.insert({viewer.Name(),{viewer,fetched,recent.begin()}});
+		while (entries.size() > VIEWER_CACHE_CAPACITY)
+		{
+			entries.erase(recent.back());
+			recent.pop_back();
+		}
+	}
+
+	void Cache::Load()
+	{
+		static const char *OPERATION="load snapshot";
+
+		QFile file(Filesystem::DataPath().filePath(VIEWER_CACHE_FILENAME));
+		if (!file.exists()) return;
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			emit Print(QString("Failed to open viewer cache: %1").arg(file.fileName()),OPERATION);
+			return;
+		}
+
+		const JSON::ParseResult parsedJSON=JSON::Parse(file.readAll());
+		if (!parsedJSON)
+		{
+			emit Print(QString("Failed to parse viewer cache: %1").arg(parsedJSON.error),OPERATION);
+			return;
+		}
+
+		// the snapshot is saved least recently used first, so storing in order rebuilds the recency list
+		const QJsonArray snapshot=parsedJSON().array();
+		for (const QJsonValue &value : snapshot)
+		{
+			const QJsonObject entry=value.toObject();
+			const std::chrono::milliseconds fetched(entry.value(JSON_KEY_VIEWER_FETCHED).toInteger());
+			if (TimeConvert::Now()-fetched > VIEWER_CACHE_LIFETIME) continue;
+			Store({entry.value(JSON_KEY_VIEWER_LOGIN).toString(),entry.value(JSON_KEY_VIEWER_ID).toString(),entry.value(JSON_KEY_VIEWER_DISPLAY_NAME).toString(),entry.value(JSON_KEY_VIEWER_PROFILE_IMAGE_URL).toString(),entry.value(JSON_KEY_VIEWER_DESCRIPTION).toString()},fetched);
+		}
+	}
+
+	void Cache::Save() const
+	{
+		// written to the side and swapped in, so quitting partway through leaves the last good copy
+		QSaveFile file(Filesystem::DataPath().filePath(VIEWER_CACHE_FILENAME));
+		if (!file.open(QIODevice::WriteOnly)) return; // nothing to be done about it on the way out, and the cache will just start cold
+
+		QJsonArray snapshot;
+		for (auto login=recent.rbegin(); login != recent.rend(); ++login)
+		{
+			const Entry &entry=entries.at(*login);
+			snapshot.append(QJsonObject{
+				{JSON_KEY_VIEWER_LOGIN,entry.viewer.Name()},
+				{JSON_KEY_VIEWER_ID,entry.viewer.ID()},
+				{JSON_KEY_VIEWER_DISPLAY_NAME,entry.viewer.DisplayName()},
+				{JSON_KEY_VIEWER_PROFILE_IMAGE_URL,entry.viewer.ProfileImageURL().toString()},
+				{JSON_KEY_VIEWER_DESCRIPTION,entry.viewer.Description()},
+				{JSON_KEY_VIEWER_FETCHED,static_cast<qint64>(entry.fetched.count())}
+			});
+		}
+		file.write(QJsonDocument(snapshot).toJson(QJsonDocument::Compact));
+		file.commit();
+	}
+
+	Remote::Remote(Cache &cache,const QString &username,bool speculative) : name(username.toLower())
+	{
+		if (std::optional<Local> viewer=cache.Find(name); viewer)
+		{
+			// still deliver on the event loop, since callers connect after constructing us
+			QMetaObject::invokeMethod(this,[this,viewer=*viewer]() {
+				emit Recognized(viewer);
+				deleteLater();
+			},Qt::QueuedConnection);
+			return;
+		}
+
+		connect(&cache,&Cache::Resolved,this,[this](const QString &login,const Local &viewer) {
+			if (login != name) return;
+			emit Recognized(viewer);
+			deleteLater();
+		});
+		connect(&cache,&Cache::Failed,this,[this](const QString &login) {
+			if (login != name) return;
+			emit Unrecognized();
+			deleteLater();
+		});
+		cache.Request(name,speculative);
+	}
+
+	Store::Store()
+	{
+		Grow(VIEWER_STORE_MINIMUM_SLOTS);
+	}
+
+	std::optional<ID> Store::Find(QStringView login) const
+	{
+		ID viewer=slots[Probe(login,static_cast<quint32>(qHash(login)))];
+		if (viewer == EMPTY) return std::nullopt;
+		return viewer;
+	}
+
+	ID Store::Intern(const QString &login)
+	{
+		const quint32 hash=static_cast<quint32>(qHash(login));
+		std::size_t slot=Probe(login,hash);
+		if (slots[slot] != EMPTY) return slots[slot];
+
+		// keep the table at most half full so probes stay short
+		if ((logins.size()+1)*2 > slots.size())
+		{
+			Grow(slots.size()*2);
+			slot=Probe(login,hash);
+		}
+
+		const ID viewer=static_cast<ID>(logins.size());
+		logins.push_back(login);
+		hashes.push_back(hash);
+		flags.push_back(static_cast<quint8>(Flag::COMMANDS));
+		slots[slot]=viewer;
+		return viewer;
+	}
+
+	const QString& Store::Login(ID viewer) const
+	{
+		return logins[viewer];
+	}
+
+	ID Store::Size() const
+	{
+		return static_cast<ID>(logins.size());
+	}
+
+	void Store::Reserve(std::size_t count)
+	{
+		logins.reserve(count);
+		hashes.reserve(count);
+		flags.reserve(count);
+		if (count*2 > slots.size()) Grow(std::bit_ceil(count*2));
+	}
+
+	bool Store::Test(ID viewer,Flag flag) const
+	{
+		return flags[viewer] & static_cast<quint8>(flag);
+	}
+
+	void Store::Set(ID viewer,Flag flag,bool value)
+	{
+		if (value)
+			flags[viewer]|=static_cast<quint8>(flag);
+		else
+			flags[viewer]&=~static_cast<quint8>(flag);
+	}
+
+	quint8 Store::Flags(ID viewer) const
+	{
+		return flags[viewer];
+	}
+
+	void Store::Flags(ID viewer,quint8 value)
+	{
+		flags[viewer]=value;
+	}
+
+	std::size_t Store::Probe(QStringView login,quint32 hash) const
+	{
+		const std::size_t mask=slots.size()-1;
+		std::size_t slot=hash & mask;
+		while (slots[slot] != EMPTY && (hashes[slots[slot]] != hash || logins[slots[slot]] != login)) slot=(slot+1) & mask;
+		return slot;
+	}
+
+	void Store::Grow(std::size_t capacity)
+	{
+		slots.assign(capacity,EMPTY);
+		const std::size_t mask=capacity-1;
+		for (ID viewer=0; viewer < logins.size(); viewer++)
+		{
+			std::size_t slot=hashes[viewer] & mask;
+			while (slots[slot] != EMPTY) slot=(slot+1) & mask;
+			slots[slot]=viewer;
+		}
+	}
+}
+
+namespace Chat
+{
+	void History::Add(const QString &id,quint64 user,QByteArrayView room)
+	{
+		entries[next]={id,user,Room(room)};
+		next=(next+1)%entries.size();
+	}
+
+	QStringList History::Purge(quint64 user,QByteArrayView room)
+	{
+		// a ban only applies to the room it happened in, even though every room shares the chat pane
+		const quint16 index=Room(room);
+		QStringList ids;
+		for (Entry &entry : entries)
+		{
+			if (entry.id.isEmpty() || entry.user != user || entry.room != index) continue;
+			ids.append(entry.id);
+			entry.id.clear();
+		}
+		return ids;
+	}
+
+	QStringList History::Clear(QByteArrayView room)
+	{
+		const quint16 index=Room(room);
+		QStringList ids;
+		for (Entry &entry : entries)
+		{
+			if (entry.id.isEmpty() || entry.room != index) continue;
+			ids.append(entry.id);
+			entry.id.clear();
+		}
+		return ids;
+	}
+
+	quint16 History::Room(QByteArrayView room)
+	{
+		for (std::size_t index=0; index < rooms.size(); index++)
+		{
+			if (rooms[index] == room) return static_cast<quint16>(index);
+		}
+		rooms.emplace_back(room.toByteArray());
+		return static_cast<quint16>(rooms.size()-1);
+	}
+
+	void Message::Recycle()
+	{
+		// clear() would let go of the buffers, where truncating keeps them for the next message
+		// emotes are left in place too, since the next message writes over their slots and only drops the ones it doesn't use
+		id.truncate(0);
+		displayName.truncate(0);
+		text.truncate(0);
+		color=QColor();
+		badges.clear();
+		pending.clear();
+		action=false;
+		broadcaster=false;
+		moderator=false;
+		html=false;
+	}
+
+	std::shared_ptr<Message> Pool::Acquire()
+	{
+		// the next one in line has almost always been released by the time we come back around to it
+		for (std::size_t attempt=0; attempt < messages.size(); attempt++)
+		{
+			std::shared_ptr<Message> &candidate=messages[next];
+			next=(next+1)%messages.size();
+			if (candidate.use_count() > 1) continue;
+			candidate->Recycle();
+			return candidate;
+		}
+
+		if (messages.size() >= LIMIT) return std::make_shared<Message>();
+		return messages.emplace_back(std::make_shared<Message>());
+	}
 }
 
 namespace JSON
@@ -10,8 +10,14 @@
 #include <QFile>
 #include <QJsonObject>
 #include <memory>
+#include <functional>
+#include <QTimer>
+#include <list>
+#include <deque>
+#include <limits>
 #include "settings.h"
 #include "security.h"
+#include "cooldown.h"
 
 enum class CommandType
 {
@@ -50,10 +56,10 @@ public:
 	using Lookup=std::unordered_map<QString,Command>;
 	Command() : Command({},{},CommandType::BLANK,false,true,{},{},{},{}) { }
 	Command(const QString &name,const QString &description,const CommandType &type,bool protect=false) : Command(name,description,type,false,true,{},{},{},{},protect) { }
-	Command(const QString &name,const QString &description,const CommandType &type,bool random,bool duplicates,const QString &path,const QStringList &filters,const QString &message,const QStringList &viewers,bool protect=false) : name(name), description(description), type(type), random(random), duplicates(duplicates), protect(protect), path(path), files(std::make_shared<File::List>(path,filters)), message(message), viewers(viewers), parent(nullptr) { }
+	Command(const QString &name,const QString &description,const CommandType &type,bool random,bool duplicates,const QString &path,const QStringList &filters,const QString &message,const QStringList &viewers,bool protect=false,const Cooldown::Policy &limits={}) : name(name), description(description), type(type), random(random), duplicates(duplicates), protect(protect), path(path), filters(filters), files(std::make_shared<File::List>()), message(message), viewers(viewers), limits(limits), parent(nullptr) { }
 	Command(const QString &name,Command* const parent);
-	Command(const Command &command,const QString &message) : name(command.name), description(command.description), type(command.type), random(command.random), duplicates(command.duplicates), protect(command.protect), path(command.path), files(command.files), message(message), viewers(command.viewers), parent(nullptr) { }
-	Command(const Command &other) : name(other.name), description(other.description), type(other.type), random(other.random), duplicates(other.duplicates), protect(other.protect), path(other.path), files(other.files), message(other.message), viewers(other.viewers), parent(nullptr) { }
+	Command(const Command &command,const QString &message) : name(command.name), description(command.description), type(command.type), random(command.random), duplicates(command.duplicates), protect(command.protect), path(command.path), filters(command.filters), files(command.files), message(message), viewers(command.viewers), limits(command.limits), parent(nullptr) { }
+	Command(const Command &other) : name(other.name), description(other.description), type(other.type), random(other.random), duplicates(other.duplicates), protect(other.protect), path(other.path), filters(other.filters), files(other.files), message(other.message), viewers(other.viewers), limits(other.limits), parent(nullptr) { }
 	const QString& Name() const { return name; }
 	const QString& Description() const { return description; }
 	CommandType Type() const { return type; }
@@ -64,8 +70,11 @@ public:
 	const QString File();
 	const QString& Message() const { return message; }
 	const QStringList& Viewers() const { return viewers; }
+	const Cooldown::Policy& Limits() const { return limits; }
 	const Command* Parent() const { return parent; }
 	const std::vector<Command*>& Children() const { return children; }
+	bool Equivalent(const Command &other) const;
+	void Disown() { children.clear(); }
 	static QStringList FileListFilters(const CommandType type);
 protected:
 	QString name;
@@ -75,9 +84,11 @@ protected:
 	bool duplicates;
 	bool protect;
 	QString path;
-	std::shared_ptr<File::List> files;
+	QStringList filters;
+	std::shared_ptr<File::List> files; //! shared with aliases and copies, and not filled in until the first time it's needed
 	QString message;
 	QStringList viewers; //! the names of the viewers needed in chat to trigger the command
+	Cooldown::Policy limits;
 	Command *parent;
 	std::vector<Command*> children;
 };
@@ -91,6 +102,7 @@ namespace Music
 		QString artist;
 		QImage cover;
 		bool valid=false;
+		QString error;
 	};
 
 	class Player : public QObject
@@ -101,7 +113,7 @@ namespace Music
 		void DuckVolume(bool duck);
 		void Volume(int targetVolume,std::chrono::seconds duration);
 		bool Playing() const;
-		struct Metadata Metadata() const;
+		void Metadata(std::function<void(const struct Metadata&)> deliver);
 		QString Filename() const;
 		void Sources(const File::List &sources);
 		const File::List& Sources();
@@ -226,7 +238,8 @@ namespace Music
 				QByteArray MIMEType;
 				PictureType pictureType;
 				QByteArray description;
-				QImage picture;
+				QByteArray pictureData;
+				mutable QImage picture; //! not decoded until someone actually asks for it
 				void ParseEncoding();
 				void ParseMIMEType();
 				void ParsePictureType();
@@ -281,7 +294,7 @@ namespace Viewer
 		{
 			Q_OBJECT
 		public:
-			Remote(const QUrl &profileImageURL);
+			Remote(const QUrl &profileImageURL,QObject *requester);
 			operator QImage() const;
 		protected:
 			QImage image;
@@ -298,7 +311,8 @@ namespace Viewer
 		const QString& Name() const;
 		const QString& ID() const;
 		const QString& DisplayName() const;
-		ProfileImage::Remote* ProfileImage() const;
+		ProfileImage::Remote* ProfileImage(QObject *requester) const;
+		const QUrl& ProfileImageURL() const;
 		const QString& Description() const;
 	protected:
 		QString name;
@@ -308,11 +322,51 @@ namespace Viewer
 		QString description;
 	};
 
+	// Profiles rarely change during a stream, so keep the ones we've asked Helix
+	// about around for a while instead of asking again for every command and arrival
+	class Cache : public QObject
+	{
+		Q_OBJECT
+	public:
+		Cache(Security &security,QObject *parent=nullptr);
+		~Cache();
+		std::optional<Local> Find(const QString &login);
+		void Request(const QString &login,bool speculative=false);
+		void Load();
+	protected:
+		struct Entry
+		{
+			Local viewer;
+			std::chrono::milliseconds fetched; //! wall clock time, so it still means something after a restart
+			std::list<QString>::iterator recency;
+		};
+		std::unordered_map<QString,Entry> entries;
+		std::list<QString> recent; //! most recently used logins at the front
+		std::unordered_map<QString,std::chrono::steady_clock::time_point> pending; //! logins with a request queued or in flight, and when they were first asked for
+		std::deque<QString> queued; //! logins waiting for the next batch to go out
+		std::deque<QString> prefetches; //! logins nobody is waiting on yet, sent only with room to spare
+		QTimer batchTimer;
+		Security &security;
+		quint64 batches;
+		quint64 batchedLogins;
+		void Store(const Local &viewer,std::chrono::milliseconds fetched);
+		void Resolve(const QString &login,const Local &viewer);
+		void Fail(const QString &login);
+		void Dispatch();
+		void Send(const QStringList &logins);
+		void Save() const;
+		static bool ValidLogin(QStringView login);
+	signals:
+		void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("viewer cache"));
+		void Resolved(const QString &login,const Viewer::Local &viewer);
+		void Failed(const QString &login);
+	};
+
 	class Remote : public QObject
 	{
 		Q_OBJECT
 	public:
-		Remote(Security &security,const QString &username);
+		Remote(Cache &cache,const QString &username,bool speculative=false);
 	protected:
 		QString name;
 		void DownloadProfileImage(const QString &url);
@@ -322,24 +376,75 @@ namespace Viewer
 		void Unrecognized();
 	};
 
-	struct Attributes
+	using ID=quint32; //! dense, assigned in the order viewers are first seen
+
+	enum class Flag : quint8
 	{
-		bool commands { true };
-		bool welcomed { false };
-		bool bot { false };
-		bool limited { false };
-		bool subscribed { false };
-		std::chrono::time_point<std::chrono::system_clock> commandTimestamp;
+		COMMANDS=1 << 0,
+		WELCOMED=1 << 1,
+		BOT=1 << 2,
+		LIMITED=1 << 3,
+		SUBSCRIBED=1 << 4
+	};
+
+	// Everything we remember about the viewers we've seen, kept in flat arrays indexed
+	// by ID so a channel with a long history doesn't cost a few allocations per viewer
+	class Store
+	{
+	public:
+		Store();
+		std::optional<ID> Find(QStringView login) const;
+		ID Intern(const QString &login);
+		const QString& Login(ID viewer) const;
+		ID Size() const;
+		void Reserve(std::size_t count);
+		bool Test(ID viewer,Flag flag) const;
+		void Set(ID viewer,Flag flag,bool value=true);
+		quint8 Flags(ID viewer) const;
+		void Flags(ID viewer,quint8 value);
+	protected:
+		std::vector<QString> logins;
+		std::vector<quint32> hashes; //! kept so growing the table doesn't rehash every login
+		std::vector<quint8> flags;
+		std::vector<ID> slots; //! open addressing (linear probing) from login hash to ID
+		static constexpr ID EMPTY=std::numeric_limits<ID>::max();
+		std::size_t Probe(QStringView login,quint32 hash) const;
+		void Grow(std::size_t capacity);
 	};
 }
 
 namespace Chat
 {
+	inline constexpr std::size_t SCROLLBACK=1000; //! how many messages the chat pane holds on to
+
+	// Remembers who sent each of the messages that are still in the chat pane's scrollback,
+	// so purging someone doesn't mean keeping every message ID seen during the stream
+	class History
+	{
+	public:
+		History(std::size_t capacity=SCROLLBACK) : entries(capacity), next(0) { }
+		void Add(const QString &id,quint64 user,QByteArrayView room);
+		QStringList Purge(quint64 user,QByteArrayView room);
+		QStringList Clear(QByteArrayView room);
+	protected:
+		struct Entry
+		{
+			QString id;
+			quint64 user;
+			quint16 room;
+		};
+		std::vector<Entry> entries; //! oldest message is overwritten once it falls out of the scrollback
+		std::size_t next;
+		std::vector<QByteArray> rooms; //! only ever a handful, so entries refer to them by index instead of each holding a copy
+		quint16 Room(QByteArrayView room);
+	};
+
 	struct Emote
 	{
 		QString name {};
 		QString id {};
 		QString path {};
+		QString url {}; //! only third-party emotes have one, since Twitch's can be found from the ID
 		int start { 0 };
 		int end { 0 };
 		bool operator<(const Emote &other) const { return start < other.start; }
@@ -354,11 +459,27 @@ namespace Chat
 		QColor color {};
 		QStringList badges {};
 		std::vector<Chat::Emote> emotes {};
+		QStringList pending {}; //! images the message uses that are still downloading
 		bool action { false };
 		bool broadcaster { false };
 		bool moderator { false };
 		bool html { false };
 		bool Privileged() const { return broadcaster || moderator; }
+		void Recycle();
+	};
+
+	// Messages are done with as soon as the chat pane has appended them, so rather than
+	// allocating a fresh one for every line, the same handful go around again, keeping
+	// the text, badge and emote buffers they grew into along the way.
+	class Pool
+	{
+	public:
+		Pool() : next(0) { }
+		std::shared_ptr<Message> Acquire();
+	protected:
+		std::vector<std::shared_ptr<Message>> messages; //! a message is free again once we hold the only handle to it
+		std::size_t next;
+		static constexpr std::size_t LIMIT=64; //! past this, something is holding on to messages and they're better off not pooled
 	};
 }
 
@@ -31,12 +31,31 @@ const char *JSON_KEY_EVENT_HYPE_TRAIN_LEVEL="level";
 const char *JSON_KEY_EVENT_HYPE_TRAIN_PROGRESS="progress";
 const char *JSON_KEY_EVENT_HYPE_TRAIN_TOTAL="goal";
 
-const char *MESSAGE_TYPE_WELCOME="session_welcome";
-const char *MESSAGE_TYPE_KEEPALIVE="session_keepalive";
-const char *MESSAGE_TYPE_NOTIFICATION="notification";
+constexpr const char *MESSAGE_TYPE_WELCOME="session_welcome";
+constexpr const char *MESSAGE_TYPE_KEEPALIVE="session_keepalive";
+constexpr const char *MESSAGE_TYPE_NOTIFICATION="notification";
 
 const char *EventSub::SETTINGS_CATEGORY_EVENTS="Events";
 
+constexpr Keyword::Table<MessageType,3> messageTypes({
+	{MESSAGE_TYPE_WELCOME,MessageType::WELCOME},
+	{MESSAGE_TYPE_NOTIFICATION,MessageType::NOTIFICATION},
+	{MESSAGE_TYPE_KEEPALIVE,MessageType::KEEPALIVE}
+});
+
+// TODO: find a better name for this
+constexpr Keyword::Table<SubscriptionType,9> subscriptionTypes({
+	{SUBSCRIPTION_TYPE_FOLLOW,SubscriptionType::CHANNEL_FOLLOW},
+	{SUBSCRIPTION_TYPE_REDEMPTION,SubscriptionType::CHANNEL_REDEMPTION},
+	{SUBSCRIPTION_TYPE_CHEER,SubscriptionType::CHANNEL_CHEER},
+	{SUBSCRIPTION_TYPE_RAID,SubscriptionType::CHANNEL_RAID},
+	{SUBSCRIPTION_TYPE_SUBSCRIPTION,SubscriptionType::CHANNEL_SUBSCRIPTION},
+	{SUBSCRIPTION_TYPE_RESUBSCRIPTION,SubscriptionType::CHANNEL_SUBSCRIPTION},
+	{SUBSCRIPTION_TYPE_HYPE_TRAIN_START,SubscriptionType::CHANNEL_HYPE_TRAIN},
+	{SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS,SubscriptionType::CHANNEL_HYPE_TRAIN},
+	{SUBSCRIPTION_TYPE_HYPE_TRAIN_END,SubscriptionType::CHANNEL_HYPE_TRAIN}
+});
+
 enum class TwitchCloseCode
 {
 	INTERNAL_SERVER_ERROR=4000,
@@ -53,20 +72,6 @@ EventSub::EventSub(Security &security,QObject *parent) : QObject(parent),
 	security(security),
 	settingURL(SETTINGS_CATEGORY_EVENTS,"WebsocketURL","wss://eventsub.wss.twitch.tv/ws")
 {
-	messageTypes.insert({MESSAGE_TYPE_WELCOME,MessageType::WELCOME});
-	messageTypes.insert({MESSAGE_TYPE_NOTIFICATION,MessageType::NOTIFICATION});
-	messageTypes.insert({MESSAGE_TYPE_KEEPALIVE,MessageType::KEEPALIVE});
-
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_FOLLOW,SubscriptionType::CHANNEL_FOLLOW});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_REDEMPTION,SubscriptionType::CHANNEL_REDEMPTION});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_CHEER,SubscriptionType::CHANNEL_CHEER});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_RAID,SubscriptionType::CHANNEL_RAID});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_SUBSCRIPTION,SubscriptionType::CHANNEL_SUBSCRIPTION});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_RESUBSCRIPTION,SubscriptionType::CHANNEL_SUBSCRIPTION});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_HYPE_TRAIN_START,SubscriptionType::CHANNEL_HYPE_TRAIN});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS,SubscriptionType::CHANNEL_HYPE_TRAIN});
-	subscriptionTypes.insert({SUBSCRIPTION_TYPE_HYPE_TRAIN_END,SubscriptionType::CHANNEL_HYPE_TRAIN});
-
 	connect(&keepalive,&QTimer::timeout,this,&EventSub::Dead);
 
 	connect(&socket,&QWebSocket::disconnected,this,&EventSub::SocketClosed);
@@ -227,13 +232,14 @@ void EventSub::ParseMessage(QString message)
 		return;
 	}
 
-	auto messageType=messageTypes.find(type->toString());
-	if (messageType == messageTypes.end())
+	const QString typeName=type->toString();
+	std::optional<MessageType> messageType=messageTypes.Find(QStringView(typeName));
+	if (!messageType)
 	{
-		emit Print(u"Unknown message type (%1)"_s.arg(type->toString()),OPERATION_PARSE_MESSAGE);
+		emit Print(u"Unknown message type (%1)"_s.arg(typeName),OPERATION_PARSE_MESSAGE);
 		return;
 	}
-	switch (messageType->second)
+	switch (*messageType)
 	{
 	case MessageType::WELCOME:
 		ParseWelcome(payload->toObject());
@@ -294,11 +300,8 @@ void EventSub::ParseNotification(QJsonObject notification)
 	SubscriptionType subscriptionType=SubscriptionType::UNKNOWN;
 	if (auto subscriptionTypeCandidate=subscriptionObject.find(JSON_KEY_PAYLOAD_SUBSCRIPTION_TYPE); subscriptionTypeCandidate != subscriptionObject.end())
 	{
-		QString key=subscriptionTypeCandidate->toString();
-		if (auto subscriptionTypeCandidate=subscriptionTypes.find(key); subscriptionTypeCandidate != subscriptionTypes.end())
-		{
-			subscriptionType=subscriptionTypeCandidate->second;
-		}
+		const QString key=subscriptionTypeCandidate->toString();
+		subscriptionType=subscriptionTypes.Find(QStringView(key)).value_or(SubscriptionType::UNKNOWN);
 	}
 	if (subscriptionType == SubscriptionType::UNKNOWN) return;
 
@@ -8,15 +8,15 @@
 #include "security.h"
 #include "entities.h"
 
-inline const char *SUBSCRIPTION_TYPE_FOLLOW="channel.follow";
-inline const char *SUBSCRIPTION_TYPE_REDEMPTION="channel.channel_points_custom_reward_redemption.add";
-inline const char *SUBSCRIPTION_TYPE_CHEER="channel.cheer";
-inline const char *SUBSCRIPTION_TYPE_RAID="channel.raid";
-inline const char *SUBSCRIPTION_TYPE_SUBSCRIPTION="channel.subscribe";
-inline const char *SUBSCRIPTION_TYPE_RESUBSCRIPTION="channel.subscription.message";
-inline const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_START="channel.hype_train.begin";
-inline const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS="channel.hype_train.progress";
-inline const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_END="channel.hype_train.end";
+inline constexpr const char *SUBSCRIPTION_TYPE_FOLLOW="channel.follow";
+inline constexpr const char *SUBSCRIPTION_TYPE_REDEMPTION="channel.channel_points_custom_reward_redemption.add";
+inline constexpr const char *SUBSCRIPTION_TYPE_CHEER="channel.cheer";
+inline constexpr const char *SUBSCRIPTION_TYPE_RAID="channel.raid";
+inline constexpr const char *SUBSCRIPTION_TYPE_SUBSCRIPTION="channel.subscribe";
+inline constexpr const char *SUBSCRIPTION_TYPE_RESUBSCRIPTION="channel.subscription.message";
+inline constexpr const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_START="channel.hype_train.begin";
+inline constexpr const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_PROGRESS="channel.hype_train.progress";
+inline constexpr const char *SUBSCRIPTION_TYPE_HYPE_TRAIN_END="channel.hype_train.end";
 
 enum class MessageType
 {
@@ -39,8 +39,6 @@ enum class SubscriptionType
 class EventSub : public QObject
 {
 	Q_OBJECT
-	using MessageTypes=std::unordered_map<QString,MessageType>;
-	using SubscriptionTypes=std::unordered_map<QString,SubscriptionType>;
 public:
 	EventSub(Security &security,QObject *parent=nullptr);
 	void Subscribe();
@@ -48,8 +46,6 @@ public:
 protected:
 	Security &security;
 	QString buffer;
-	MessageTypes messageTypes;
-	SubscriptionTypes subscriptionTypes; // TODO: find a better name for this
 	std::queue<QString> defaultTypes;
 	QWebSocket socket;
 	QString sessionID;
@@ -1,15 +1,23 @@
 #pragma once
 
 #include <QString>
+#include <QByteArrayView>
 #include <QStandardPaths>
 #include <QDir>
 #include <QJsonDocument>
 #include <QFont>
 #include <QFontMetrics>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <cmath>
+#include <deque>
 #include <optional>
 #include <random>
 #include <stdexcept>
+#include <string_view>
+#include <vector>
 
 using namespace Qt::Literals::StringLiterals;
 
@@ -123,6 +131,93 @@ namespace TimeConvert
 	inline const std::chrono::milliseconds Now() { return std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now()).time_since_epoch(); }
 }
 
+namespace RateLimit
+{
+	// Starts full and tokens trickle back in continuously, so it allows a burst of the whole
+	// capacity and then a steady rate after that. That's what we want for cooldowns, but a
+	// server that counts sends over a window would see up to twice the capacity in one window,
+	// so use SlidingWindow for those.
+	class TokenBucket
+	{
+		using Clock=std::chrono::steady_clock;
+	public:
+		TokenBucket(double capacity,std::chrono::milliseconds window) : capacity(capacity), rate(capacity/window.count()), tokens(capacity), updated(Clock::now()) { }
+		void Limit(double capacity,std::chrono::milliseconds window)
+		{
+			Refill();
+			this->capacity=capacity;
+			rate=capacity/window.count();
+			tokens=std::min(tokens,capacity);
+		}
+		bool Take(double count=1.0)
+		{
+			Refill();
+			if (tokens < count) return false;
+			tokens-=count;
+			return true;
+		}
+		std::chrono::milliseconds Wait(double count=1.0)
+		{
+			Refill();
+			if (tokens >= count) return std::chrono::milliseconds(0);
+			return std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(std::ceil((count-tokens)/rate)));
+		}
+	protected:
+		double capacity;
+		double rate; //! tokens regained per millisecond
+		double tokens;
+		Clock::time_point updated;
+		void Refill()
+		{
+			const Clock::time_point now=Clock::now();
+			tokens=std::min(capacity,tokens+std::chrono::duration<double,std::milli>(now-updated).count()*rate);
+			updated=now;
+		}
+	};
+
+	// Remembers when each send in the trailing window went out and only allows another
+	// while fewer than the limit have, so no stretch of that length ever holds more than
+	// the limit, however the server happens to line its windows up
+	class SlidingWindow
+	{
+		using Clock=std::chrono::steady_clock;
+	public:
+		SlidingWindow(std::size_t capacity,std::chrono::milliseconds window) : capacity(capacity), window(window) { }
+		void Limit(std::size_t capacity,std::chrono::milliseconds window)
+		{
+			this->capacity=capacity;
+			this->window=window;
+		}
+		bool Take(std::size_t count=1)
+		{
+			const Clock::time_point now=Clock::now();
+			Expire(now);
+			if (sends.size()+count > capacity) return false;
+			sends.insert(sends.end(),count,now);
+			return true;
+		}
+		std::chrono::milliseconds Wait(std::size_t count=1)
+		{
+			const Clock::time_point now=Clock::now();
+			Expire(now);
+			if (sends.size()+count <= capacity) return std::chrono::milliseconds(0);
+			if (count > capacity) throw std::logic_error("Sending more at once than the limit allows in a whole window");
+
+			// the send that has to age out before there's room for this many more
+			const Clock::time_point blocking=sends[sends.size()+count-capacity-1];
+			return std::chrono::ceil<std::chrono::milliseconds>(blocking+window-now);
+		}
+	protected:
+		std::size_t capacity;
+		std::chrono::milliseconds window;
+		std::deque<Clock::time_point> sends;
+		void Expire(Clock::time_point now)
+		{
+			while (!sends.empty() && sends.front()+window <= now) sends.pop_front();
+		}
+	};
+}
+
 namespace StringView
 {
 	inline std::optional<QStringView> Take(QStringView &window,QChar delimiter)
@@ -155,6 +250,111 @@ namespace StringView
 	}
 }
 
+namespace ByteArrayView
+{
+	inline std::optional<QByteArrayView> Take(QByteArrayView &window,char delimiter)
+	{
+		const qsizetype index=window.indexOf(delimiter);
+		QByteArrayView candidate=index < 0 ? window : window.first(index);
+		window=index < 0 ? QByteArrayView{} : window.sliced(index+1);
+		if (candidate.isEmpty()) return std::nullopt;
+		return candidate.trimmed();
+	}
+
+	inline std::optional<QByteArrayView> First(const QByteArrayView &window,char delimiter)
+	{
+		const qsizetype index=window.indexOf(delimiter);
+		QByteArrayView candidate=index < 0 ? window : window.first(index);
+		if (candidate.isEmpty()) return std::nullopt;
+		return candidate.trimmed();
+	}
+
+	inline std::optional<QByteArrayView> Last(const QByteArrayView &window,char delimiter)
+	{
+		QByteArrayView candidate=window.sliced(window.lastIndexOf(delimiter)+1);
+		if (candidate.isEmpty()) return std::nullopt;
+		return candidate.trimmed();
+	}
+}
+
+namespace Keyword
+{
+	template <typename T>
+	struct Entry
+	{
+		std::string_view key;
+		T value;
+	};
+
+	// A fixed set of keywords hashed at compile time into a table with no collisions,
+	// so a lookup is one hash, one slot, and one comparison, and nothing allocates.
+	// Keywords are expected to be ASCII, which lets byte and UTF-16 views share a hash.
+	template <typename T,std::size_t N>
+	class Table
+	{
+		static constexpr std::size_t SIZE=std::bit_ceil(N*2);
+	public:
+		consteval Table(const Entry<T> (&entries)[N])
+		{
+			while (!Place(entries))
+			{
+				seed++;
+				if (seed > 0xFFFF) throw std::logic_error("No perfect hash seed exists for this keyword list");
+			}
+		}
+
+		constexpr std::optional<T> Find(QByteArrayView key) const
+		{
+			return Match(key.data(),key.size());
+		}
+
+		constexpr std::optional<T> Find(QStringView key) const
+		{
+			return Match(key.utf16(),key.size());
+		}
+
+	protected:
+		std::array<Entry<T>,SIZE> slots {};
+		quint32 seed { 0 };
+
+		template <typename C> static constexpr quint32 Hash(const C *data,qsizetype size,quint32 seed)
+		{
+			quint32 hash=2166136261u^seed;
+			for (qsizetype index=0; index < size; index++)
+			{
+				hash^=static_cast<quint32>(static_cast<std::make_unsigned_t<C>>(data[index]));
+				hash*=16777619u;
+			}
+			hash^=hash >> 15;
+			return hash;
+		}
+
+		constexpr bool Place(const Entry<T> (&entries)[N])
+		{
+			slots={};
+			for (const Entry<T> &entry : entries)
+			{
+				Entry<T> &slot=slots[Hash(entry.key.data(),static_cast<qsizetype>(entry.key.size()),seed)&(SIZE-1)];
+				if (!slot.key.empty()) return false;
+				slot=entry;
+			}
+			return true;
+		}
+
+		template <typename C> constexpr std::optional<T> Match(const C *data,qsizetype size) const
+		{
+			if (size < 1) return std::nullopt;
+			const Entry<T> &slot=slots[Hash(data,size,seed)&(SIZE-1)];
+			if (static_cast<qsizetype>(slot.key.size()) != size) return std::nullopt;
+			for (qsizetype index=0; index < size; index++)
+			{
+				if (static_cast<char16_t>(static_cast<unsigned char>(slot.key[index])) != static_cast<char16_t>(data[index])) return std::nullopt;
+			}
+			return slot.value;
+		}
+	};
+}
+
 namespace Filesystem
 {
 	inline const QDir DataPath()
@@ -250,6 +450,78 @@ namespace JSON
 
 namespace Container
 {
+	// Lock-free queue for exactly one producer thread and one consumer thread.
+	// Indices only ever increase and are masked on access, so full and empty are never ambiguous.
+	template <typename T,std::size_t N>
+	class RingBuffer
+	{
+		static_assert(std::has_single_bit(N),"Ring buffer capacity must be a power of two");
+	public:
+		bool Push(T &&value)
+		{
+			const std::size_t position=tail.load(std::memory_order_relaxed);
+			if (position-head.load(std::memory_order_acquire) >= N) return false;
+			slots[position&(N-1)]=std::move(value);
+			tail.store(position+1,std::memory_order_release);
+			return true;
+		}
+		std::optional<T> Pop()
+		{
+			const std::size_t position=head.load(std::memory_order_relaxed);
+			if (position == tail.load(std::memory_order_acquire)) return std::nullopt;
+			std::optional<T> value(std::move(slots[position&(N-1)]));
+			head.store(position+1,std::memory_order_release);
+			return value;
+		}
+		std::size_t Size() const
+		{
+			const std::size_t consumed=head.load(std::memory_order_acquire); // read head first so it can never pass the tail we compare against
+			return tail.load(std::memory_order_acquire)-consumed;
+		}
+		bool Full() const { return Size() >= N; }
+		static constexpr std::size_t Capacity() { return N; }
+	protected:
+		std::array<T,N> slots;
+		alignas(64) std::atomic<std::size_t> head { 0 }; //! only the consumer writes this
+		alignas(64) std::atomic<std::size_t> tail { 0 }; //! only the producer writes this
+	};
+
+	// Keeps the first N elements in place and only moves everything to the heap
+	// once there are more than that, so the common small case never allocates.
+	template <typename T,std::size_t N>
+	class InlineVector
+	{
+	public:
+		void Append(const T &value)
+		{
+			if (count < N)
+			{
+				local[count++]=value;
+				return;
+			}
+			if (count == N) spilled.assign(local.begin(),local.end());
+			spilled.push_back(value);
+			count++;
+		}
+		void Clear()
+		{
+			count=0;
+			spilled.clear();
+		}
+		std::size_t Size() const { return count; }
+		bool Empty() const { return count == 0; }
+		T* begin() { return count > N ? spilled.data() : local.data(); }
+		T* end() { return begin()+count; }
+		const T* begin() const { return count > N ? spilled.data() : local.data(); }
+		const T* end() const { return begin()+count; }
+		T& operator[](std::size_t index) { return begin()[index]; }
+		const T& operator[](std::size_t index) const { return begin()[index]; }
+	protected:
+		std::array<T,N> local {};
+		std::vector<T> spilled;
+		std::size_t count { 0 };
+	};
+
 	template <Concept::AssociativeContainer T>
 	typename T::mapped_type Resolve(T &container,const typename T::key_type &key,const typename T::mapped_type &value)
 	{
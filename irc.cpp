@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include "irc.h"
+#include "globals.h"
+
+namespace IRC
+{
+	qint64 Framer::Fill(QIODevice &device)
+	{
+		// slide any partial line left over from the last read to the front
+		// of the buffer so it doesn't keep growing while we're connected
+		if (offset > 0)
+		{
+			buffer.remove(0,offset);
+			offset=0;
+		}
+
+		const qint64 available=device.bytesAvailable();
+		if (available <= 0) return 0;
+		const qsizetype size=buffer.size();
+		buffer.resize(size+available);
+		const qint64 received=device.read(buffer.data()+size,available);
+		if (received < 0)
+		{
+			buffer.resize(size);
+			return -1;
+		}
+		buffer.resize(size+received);
+		return received;
+	}
+
+	std::optional<QByteArrayView> Framer::Line()
+	{
+		const char *start=buffer.constData()+offset;
+		const char *terminator=static_cast<const char*>(std::memchr(start,'\n',buffer.size()-offset));
+		if (!terminator) return std::nullopt;
+		qsizetype length=terminator-start;
+		offset+=length+1;
+		if (length > 0 && start[length-1] == '\r') length--;
+		return QByteArrayView(start,length);
+	}
+
+	Message::Message(QByteArrayView view) : line(QByteArray::fromRawData(view.data(),view.size()))
+	{
+		const qsizetype size=line.size();
+		qsizetype position=0;
+
+		const auto skipSpaces=[this,&position,size]() {
+			while (position < size && line.at(position) == ' ') position++;
+		};
+		const auto word=[this,&position,size]() -> Span {
+			const qsizetype start=position;
+			qsizetype end=line.indexOf(' ',start);
+			if (end < 0) end=size;
+			position=end;
+			return {start,end-start};
+		};
+
+		// tags and source are both optional, but if they're there, they're always in this order
+		if (position < size && line.at(position) == '@')
+		{
+			position++;
+			tags=word();
+			skipSpaces();
+		}
+		if (position < size && line.at(position) == ':')
+		{
+			position++;
+			source=word();
+			skipSpaces();
+		}
+		if (position >= size) return;
+		command=word();
+		skipSpaces();
+
+		// everything up to a leading colon is a middle parameter
+		const qsizetype start=position;
+		qsizetype end=position;
+		while (position < size && line.at(position) != ':')
+		{
+			const Span parameter=word();
+			end=parameter.offset+parameter.length;
+			skipSpaces();
+		}
+		if (end > start) parameters={start,end-start};
+		if (position < size) trailing={position+1,size-position-1};
+	}
+
+	QByteArrayView Message::View(const Span &span) const
+	{
+		if (!span.Present()) return {};
+		return QByteArrayView(line).sliced(span.offset,span.length);
+	}
+
+	std::optional<QByteArrayView> Message::Parameter(int index) const
+	{
+		QByteArrayView window=Parameters();
+		while (!window.isEmpty())
+		{
+			std::optional<QByteArrayView> candidate=ByteArrayView::Take(window,' ');
+			if (!candidate) continue;
+			if (index-- == 0) return candidate;
+		}
+		return std::nullopt;
+	}
+
+	std::optional<QByteArrayView> Message::Trailing() const
+	{
+		if (!trailing.Present()) return std::nullopt;
+		return View(trailing);
+	}
+
+	std::optional<QByteArrayView> Message::Tag(QByteArrayView key) const
+	{
+		QByteArrayView window=Tags();
+		while (!window.isEmpty())
+		{
+			const qsizetype delimiter=window.indexOf(';');
+			const QByteArrayView pair=delimiter < 0 ? window : window.first(delimiter);
+			window=delimiter < 0 ? QByteArrayView{} : window.sliced(delimiter+1);
+			if (pair.size() <= key.size() || pair.at(key.size()) != '=' || !pair.startsWith(key)) continue;
+			return pair.sliced(key.size()+1);
+		}
+		return std::nullopt;
+	}
+
+	std::optional<QByteArrayView> Message::Nick() const
+	{
+		const QByteArrayView hostmask=Source();
+		const qsizetype delimiter=hostmask.indexOf('!');
+		if (delimiter < 1) return std::nullopt;
+		return hostmask.first(delimiter);
+	}
+
+	void Message::Detach()
+	{
+		// offsets are relative to the start of the line, so they survive the copy
+		line=QByteArray(line.constData(),line.size());
+	}
+
+	constexpr Keyword::Table<KnownTag,static_cast<std::size_t>(KnownTag::COUNT)> KNOWN_TAGS({
+		{"badges",KnownTag::BADGES},
+		{"color",KnownTag::COLOR},
+		{"display-name",KnownTag::DISPLAY_NAME},
+		{"emotes",KnownTag::EMOTES},
+		{"id",KnownTag::ID},
+		{"user-id",KnownTag::USER_ID},
+		{"mod",KnownTag::MOD},
+		{"target-msg-id",KnownTag::TARGET_MSG_ID},
+		{"target-user-id",KnownTag::TARGET_USER_ID}
+	});
+
+	Tags::Tags(const Message &message)
+	{
+		QByteArrayView window=message.Tags();
+		while (!window.isEmpty())
+		{
+			const qsizetype delimiter=window.indexOf(';');
+			const QByteArrayView pair=delimiter < 0 ? window : window.first(delimiter);
+			window=delimiter < 0 ? QByteArrayView{} : window.sliced(delimiter+1);
+			const qsizetype separator=pair.indexOf('=');
+			if (separator < 1) continue;
+			if (std::optional<KnownTag> tag=KNOWN_TAGS.Find(pair.first(separator)); tag) values[static_cast<std::size_t>(*tag)]=pair.sliced(separator+1);
+		}
+	}
+
+	EmoteRanges Emotes(QByteArrayView tag)
+	{
+		EmoteRanges ranges;
+		while (!tag.isEmpty())
+		{
+			std::optional<QByteArrayView> entry=ByteArrayView::Take(tag,'/');
+			if (!entry) continue;
+			std::optional<QByteArrayView> id=ByteArrayView::Take(*entry,':');
+			if (!id) continue;
+			while (!entry->isEmpty())
+			{
+				std::optional<QByteArrayView> occurrence=ByteArrayView::Take(*entry,',');
+				if (!occurrence) continue;
+				const char *last=occurrence->data()+occurrence->size();
+				int start=0;
+				int end=0;
+				auto [dash,startError]=std::from_chars(occurrence->data(),last,start);
+				if (startError != std::errc() || dash == last || *dash != '-') continue;
+				auto [remainder,endError]=std::from_chars(dash+1,last,end);
+				if (endError != std::errc() || remainder != last || end < start) continue;
+				ranges.Append({*id,start,end});
+			}
+		}
+
+		// ranges are grouped by emote in the tag, but everything downstream wants them in the order they appear in the text
+		std::sort(ranges.begin(),ranges.end(),[](const EmoteRange &left,const EmoteRange &right) {
+			return left.start < right.start;
+		});
+		return ranges;
+	}
+}
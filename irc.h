@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QIODevice>
+#include <array>
+#include <optional>
+#include "globals.h"
+
+namespace IRC
+{
+	// Reads whatever a device has waiting in one call and hands out complete lines
+	// as views over its own buffer. Views are only good until the next call to Fill().
+	class Framer
+	{
+	public:
+		Framer() : offset(0) { }
+		qint64 Fill(QIODevice &device);
+		std::optional<QByteArrayView> Line();
+	protected:
+		QByteArray buffer; //! bytes that haven't been framed into lines yet
+		qsizetype offset; //! start of the first line in the buffer that hasn't been handed out yet
+	};
+
+	struct Span
+	{
+		qsizetype offset { 0 };
+		qsizetype length { -1 }; //! a negative length means the field didn't appear in the line
+		bool Present() const { return length >= 0; }
+	};
+
+	// a single line from the server, broken into its parts without copying anything
+	// the message points into the socket's buffer, so it's only good until the socket
+	// reads again, unless Detach() is called to give the message its own copy
+	class Message
+	{
+	public:
+		Message() { }
+		Message(QByteArrayView line);
+		bool Valid() const { return command.length > 0; }
+		QByteArrayView Line() const { return line; }
+		QByteArrayView Tags() const { return View(tags); }
+		QByteArrayView Source() const { return View(source); }
+		QByteArrayView Command() const { return View(command); }
+		QByteArrayView Parameters() const { return View(parameters); }
+		std::optional<QByteArrayView> Parameter(int index) const;
+		std::optional<QByteArrayView> Trailing() const;
+		std::optional<QByteArrayView> Tag(QByteArrayView key) const;
+		std::optional<QByteArrayView> Nick() const;
+		void Detach();
+	protected:
+		QByteArray line;
+		Span tags;
+		Span source;
+		Span command;
+		Span parameters;
+		Span trailing;
+		QByteArrayView View(const Span &span) const;
+	};
+
+	// the tags Celeste acts on, which are the only ones worth keeping track of
+	enum class KnownTag
+	{
+		BADGES,
+		COLOR,
+		DISPLAY_NAME,
+		EMOTES,
+		ID,
+		USER_ID,
+		MOD,
+		TARGET_MSG_ID,
+		TARGET_USER_ID,
+		COUNT
+	};
+
+	// Every known tag found in a single pass over the tag string, rather than
+	// one pass for each tag asked for. Values point into the message, so they're
+	// only good for as long as it is.
+	class Tags
+	{
+	public:
+		Tags(const Message &message);
+		std::optional<QByteArrayView> Value(KnownTag tag) const { return values[static_cast<std::size_t>(tag)]; }
+	protected:
+		std::array<std::optional<QByteArrayView>,static_cast<std::size_t>(KnownTag::COUNT)> values;
+	};
+
+	struct Badge
+	{
+		QByteArrayView set;
+		QByteArrayView version;
+		QByteArrayView key; //! set and version together, exactly as they appear in the tag
+	};
+
+	template<typename F> void Badges(QByteArrayView tag,F &&found)
+	{
+		while (!tag.isEmpty())
+		{
+			const qsizetype delimiter=tag.indexOf(',');
+			const QByteArrayView key=delimiter < 0 ? tag : tag.first(delimiter);
+			tag=delimiter < 0 ? QByteArrayView{} : tag.sliced(delimiter+1);
+			const qsizetype separator=key.indexOf('/');
+			if (separator < 1 || separator == key.size()-1) continue; // a badge must have a version
+			found(Badge{
+				.set=key.first(separator),
+				.version=key.sliced(separator+1),
+				.key=key
+			});
+		}
+	}
+
+	struct EmoteRange
+	{
+		QByteArrayView id;
+		int start;
+		int end;
+	};
+	using EmoteRanges=Container::InlineVector<EmoteRange,16>; //! more than enough for nearly every message
+
+	EmoteRanges Emotes(QByteArrayView tag);
+}
@@ -6,6 +6,7 @@
 #include <QPushButton>
 #include <QGridLayout>
 #include <QListWidget>
+#include <QFileDialog>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <exception>
@@ -22,6 +23,7 @@
 const char *ORGANIZATION_NAME="EngineeringDeck";
 const char *APPLICATION_NAME="Celeste";
 const char *SUBSYSTEM_AUTHORIZATION="authorization";
+const std::chrono::milliseconds METRICS_INTERVAL=std::chrono::seconds(1);
 
 enum
 {
@@ -212,8 +214,7 @@ int main(int argc,char *argv[])
 	try
 	{
 		Log log;
-		IRCSocket socket;
-		Channel *channel=new Channel(security,&socket);
+		Channel *channel=new Channel(security);
 		Music::Player musicPlayer(true,0);
 		Bot celeste(musicPlayer,security);
 		const Command::Lookup &botCommands=celeste.DeserializeCommands(celeste.LoadDynamicCommands());
@@ -222,6 +223,7 @@ int main(int argc,char *argv[])
 		EventSub *eventSub=nullptr;
 		ApplicationWindow window;
 		UI::Metrics::Dialog metrics(&window);
+		QTimer metricsTimer;
 		UI::Status::Window<StatusPane> status(&window);
 
 		security.connect(&security,&Security::TokenRequestFailed,&security,[&application]() {
@@ -231,8 +233,9 @@ int main(int argc,char *argv[])
 		QMetaObject::Connection echo=log.connect(&log,&Log::Print,&window,QOverload<const QString&>::of(&Window::Print));
 		log.connect(&log,&Log::Print,&status.Pane(),&StatusPane::Print);
 		celeste.connect(&celeste,&Bot::ChatMessage,&window,&Window::ChatMessage);
-		celeste.connect(&celeste,&Bot::DeleteChatMessage,&window,&Window::DeleteChatMessage);
-		celeste.connect(&celeste,&Bot::RefreshChat,&window,&Window::RefreshChat);
+		celeste.connect(&celeste,&Bot::DeleteChatMessages,&window,&Window::DeleteChatMessages);
+		celeste.connect(&celeste,&Bot::ChatAsset,&window,&Window::ChatAsset);
+		celeste.connect(&celeste,&Bot::ChatAssetFailed,&window,&Window::ChatAssetFailed);
 		celeste.connect(&celeste,&Bot::Print,&log,&Log::Receive);
 		celeste.connect(&celeste,&Bot::AnnounceArrival,&window,&Window::AnnounceArrival);
 		celeste.connect(&celeste,&Bot::AnnounceRedemption,&window,&Window::AnnounceRedemption);
@@ -256,6 +259,7 @@ int main(int argc,char *argv[])
 		celeste.connect(&celeste,&Bot::PlayAudio,&window,&Window::PlayAudio);
 		celeste.connect(&celeste,&Bot::Pulse,&pulsar,QOverload<const QString&,const QString&>::of(&Pulsar::Pulse));
 		celeste.connect(&celeste,&Bot::Welcomed,&metrics,&UI::Metrics::Dialog::Acknowledged);
+		celeste.connect(&celeste,&Bot::Say,channel,&Channel::Say);
 		celeste.connect(&celeste,&Bot::Panic,&window,&Window::ShowPanicText);
 		celeste.connect(&celeste,&Bot::Panic,&celeste,[&celeste]() {
 			celeste.disconnect();
@@ -263,11 +267,14 @@ int main(int argc,char *argv[])
 		pulsar.connect(&pulsar,&Pulsar::Print,&log,&Log::Receive);
 		pulsar.connect(&pulsar,&Pulsar::Dimensions,&window,&Window::Resize);
 		channel->connect(channel,&Channel::Print,&log,&Log::Receive);
+		celeste.Serve(channel->Rooms());
 		channel->connect(channel,&Channel::Dispatch,&celeste,&Bot::ParseChatMessage);
 		channel->connect(channel,&Channel::Deleted,&celeste,&Bot::ParseChatMessageDeletion);
 		channel->connect(channel,&Channel::Ping,&celeste,&Bot::Ping);
-		channel->connect(channel,QOverload<const QString&>::of(&Channel::Joined),&metrics,&UI::Metrics::Dialog::Joined);
-		channel->connect(channel,QOverload<const QString&>::of(&Channel::Parted),&metrics,&UI::Metrics::Dialog::Parted);
+		channel->connect(channel,&Channel::JoinedBatch,&metrics,&UI::Metrics::Dialog::Joined);
+		channel->connect(channel,&Channel::PartedBatch,&metrics,&UI::Metrics::Dialog::Parted);
+		channel->connect(channel,&Channel::JoinedBatch,&celeste,&Bot::Prefetch);
+		channel->connect(channel,&Channel::PartedBatch,&celeste,&Bot::Unstage);
 		channel->connect(channel,QOverload<>::of(&Channel::Joined),&window,[&echo,&log,&celeste,&pulsar,&window]() {
 			log.disconnect(echo);
 			window.connect(&window,QOverload<const QString&,const QString&,const QString&>::of(&Window::Print),&window,QOverload<const QString&>::of(&Window::Print));
@@ -275,12 +282,9 @@ int main(int argc,char *argv[])
 			celeste.connect(&celeste,&Bot::Print,&window,QOverload<const QString&>::of(&Window::Print));
 			pulsar.connect(&pulsar,&Pulsar::Print,&window,QOverload<const QString&>::of(&Window::Print));
 			window.ShowChat();
-		});
-		channel->connect(channel,&Channel::Disconnected,&window,[channel,&window]() {
-			qApp->alert(&window);
-			qApp->beep();
-			if (MessageBox(u"Connection Failed"_s,u"Failed to connect to Twitch. Would you like to try again?"_s,QMessageBox::Question,QMessageBox::Yes|QMessageBox::No,QMessageBox::Yes) == QMessageBox::No) return;
-			channel->Connect();
+		},Qt::SingleShotConnection); // reconnecting rejoins the room, but the log only needs to be rerouted once
+		channel->connect(channel,&Channel::Disconnected,&window,[&window]() {
+			qApp->alert(&window); // the channel reconnects by itself, but let the streamer know chat dropped
 		});
 		channel->connect(channel,&Channel::Connected,eventSub,[&security,&window,&celeste,&log,&application,eventSub]() mutable {
 			if (eventSub) eventSub->deleteLater();
@@ -308,16 +312,25 @@ int main(int argc,char *argv[])
 			application.connect(&application,&QApplication::aboutToQuit,eventSub,&EventSub::deleteLater,Qt::DirectConnection);
 		});
 		channel->connect(channel,&Channel::Denied,&security,&Security::AuthorizeUser);
+		security.connect(&security,&Security::Initialized,&celeste,&Bot::LoadChatImages);
 		security.connect(&security,&Security::Initialized,channel,&Channel::Connect);
 		security.connect(&security,&Security::Print,&log,&Log::Receive);
-		application.connect(&application,&QApplication::aboutToQuit,&application,[&log,&socket,channel]() {
-			socket.connect(&socket,&IRCSocket::disconnected,&log,&Log::Archive);
+		application.connect(&application,&QApplication::aboutToQuit,&application,[&log,channel]() {
 			channel->disconnect(); // stops attempting to reconnect by removing all connections to signals
+			log.connect(channel,&QObject::destroyed,&log,&Log::Archive);
 			channel->deleteLater();
 		});
 		window.connect(&window,&Window::SuppressMusic,&celeste,&Bot::SuppressMusic);
 		window.connect(&window,&Window::RestoreMusic,&celeste,&Bot::RestoreMusic);
 		window.connect(&window,&Window::ShowMetrics,&metrics,&QDialog::show);
+		metricsTimer.connect(&metricsTimer,&QTimer::timeout,&metrics,[&metrics,channel]() {
+			if (!metrics.isVisible()) return;
+			const Channel::Metrics outbound=channel->OutboundMetrics();
+			metrics.Outbound(outbound.depth,outbound.sent,outbound.dropped);
+			const Channel::Backpressure inbound=channel->InboundMetrics();
+			metrics.Inbound(inbound.depth,inbound.stalls);
+		});
+		metricsTimer.start(METRICS_INTERVAL);
 		window.connect(&window,&Window::CloseRequested,&window,[channel,&celeste](QCloseEvent *closeEvent) {
 			if (channel->Protection())
 			{
@@ -335,6 +348,11 @@ int main(int argc,char *argv[])
 		window.connect(&window,&Window::ShowVibePlaylist,&window,[&musicPlaylist,&window,&celeste,&musicPlayer]() {
 			ShowPlaylist(musicPlaylist,window,celeste,musicPlayer);
 		});
+		window.connect(&window,&Window::ExportViewers,&window,[&window,&celeste]() {
+			const QString path=QFileDialog::getSaveFileName(&window,u"Export Viewers"_s,Bot::ViewerAttributesPath(),u"JSON (*.json)"_s);
+			if (path.isEmpty()) return;
+			if (!celeste.ExportViewerAttributes(path)) MessageBox(u"Export Viewers Failed"_s,u"Something went wrong exporting the viewer list to a file"_s,QMessageBox::Warning,QMessageBox::Ok,QMessageBox::Ok,&window);
+		});
 		window.connect(&window,&Window::ShowStatus,[&status]() {
 			status.Open();
 		});
@@ -1,24 +1,43 @@
+#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QCoreApplication>
 #include "network.h"
 #include "globals.h"
+#include "settings.h"
+#include "decoder.h"
+
+const char *CACHE_DIRECTORY="cache";
+const char *CACHE_INDEX_FILENAME="index.json";
+const char *CACHE_KEY_ETAG="etag";
+const char *CACHE_KEY_MODIFIED="modified";
+const char *CACHE_KEY_ACCESSED="accessed";
+const char *CACHE_KEY_VALIDATED="validated";
+const char *SETTINGS_CATEGORY_CACHE="Cache";
+const qint64 CACHE_REVALIDATE_INTERVAL=86400; // in seconds
+const std::chrono::milliseconds CACHE_SAVE_DELAY(1000);
 
 namespace Network
 {
 	std::queue<Request*> Request::queue;
+	std::queue<Request*> Request::background;
 	std::unique_ptr<QNetworkAccessManager> Request::networkManager;
 
-	Request* Request::Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload)
+	Request* Request::Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload,Priority priority)
 	{
-		Request *request=new Request(url,method,callback,queryParameters,headers,payload);
+		Request *request=new Request(url,method,callback,queryParameters,headers,payload,priority);
 		request->Send();
 		return request;
 	}
 
-	Request::Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload) : url(url),
+	Request::Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload,Priority priority) : url(url),
 		method(method),
 		callback(callback),
 		queryParameters(queryParameters),
 		headers(headers),
 		payload(payload),
+		priority(priority),
 		reply(nullptr)
 	{
 		if (!networkManager) networkManager=std::make_unique<QNetworkAccessManager>();
@@ -33,6 +52,11 @@ namespace Network
 		{
 			url.setQuery(queryParameters);
 			request.setUrl(url);
+			if (priority == Priority::LOW && queue.size() > 0)
+			{
+				background.push(this);
+				return;
+			}
 			if (queue.size() == 0) DeferredSend(); // if it's the first one going in the queue, trigger it
 			queue.push(this);
 			return;
@@ -72,7 +96,266 @@ namespace Network
 	{
 		// remove this network call and make the next network call if there is one waiting in the queue
 		queue.pop();
+		if (queue.size() == 0 && background.size() > 0)
+		{
+			// nothing else is waiting, so let the next low priority request have its turn
+			queue.push(background.front());
+			background.pop();
+		}
 		if (queue.size() > 0) queue.front()->DeferredSend();
 		Finished();
 	}
-}
\ No newline at end of file
+
+	QPointer<Cache> Cache::instance;
+
+	Cache::Cache() : QObject(qApp),
+		directory(Filesystem::DataPath().filePath(CACHE_DIRECTORY)),
+		total(0),
+		evictions(0)
+	{
+		// budgets are in megabytes
+		budget=static_cast<qint64>(ApplicationSetting(SETTINGS_CATEGORY_CACHE,"DiskBudget",256))*1024*1024;
+		images.setMaxCost(static_cast<qint64>(ApplicationSetting(SETTINGS_CATEGORY_CACHE,"MemoryBudget",32))*1024);
+
+		saveDelay.setSingleShot(true);
+		saveDelay.setInterval(CACHE_SAVE_DELAY);
+		connect(&saveDelay,&QTimer::timeout,this,&Cache::Save);
+		connect(qApp,&QCoreApplication::aboutToQuit,this,&Cache::Save); // in case the last change is still waiting on the timer
+
+		directory.mkpath(directory.absolutePath());
+		Load();
+	}
+
+	Cache& Cache::Instance()
+	{
+		if (!instance) instance=new Cache();
+		return *instance;
+	}
+
+	QString Cache::Key(const QUrl &url)
+	{
+		return QString::fromLatin1(QCryptographicHash::hash(url.toEncoded(),QCryptographicHash::Sha1).toHex());
+	}
+
+	QString Cache::Path(const QUrl &url)
+	{
+		return Instance().directory.filePath(Key(url));
+	}
+
+	bool Cache::Contains(const QUrl &url)
+	{
+		return Instance().entries.contains(Key(url));
+	}
+
+	quint64 Cache::Evictions()
+	{
+		return Instance().evictions;
+	}
+
+	void Cache::Fetch(const QUrl &url,Callback callback,Priority priority)
+	{
+		Cache &cache=Instance();
+		const QString key=Key(url);
+		auto entry=cache.entries.find(key);
+		if (entry != cache.entries.end() && QDateTime::currentSecsSinceEpoch()-entry->second.validated < CACHE_REVALIDATE_INTERVAL)
+		{
+			cache.Deliver(key,callback);
+			return;
+		}
+
+		// several messages can ask for the same new emote before it's arrived, so they all share the one download
+		auto [waiting,first]=cache.inflight.try_emplace(key);
+		waiting->second.push_back(callback);
+		if (!first) return;
+
+		// if we have a copy, only ask for the image again if it's changed since we got it
+		Headers headers;
+		if (entry != cache.entries.end())
+		{
+			if (!entry->second.etag.isEmpty()) headers.push_back({"If-None-Match",entry->second.etag});
+			if (!entry->second.modified.isEmpty()) headers.push_back({"If-Modified-Since",entry->second.modified});
+		}
+
+		Request::Send(url,Method::GET,[key](QNetworkReply *reply) {
+			Cache &cache=Instance();
+			std::vector<Callback> callbacks;
+			if (auto waiting=cache.inflight.extract(key); !waiting.empty()) callbacks=std::move(waiting.mapped());
+			const bool stored=cache.entries.contains(key);
+			if (reply->error())
+			{
+				// an old copy is better than nothing
+				for (const Callback &callback : callbacks)
+				{
+					if (stored)
+						cache.Deliver(key,callback);
+					else
+						callback({},reply->errorString());
+				}
+				return;
+			}
+
+			if (stored && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304)
+			{
+				cache.entries.at(key).validated=QDateTime::currentSecsSinceEpoch();
+				cache.saveDelay.start();
+				for (const Callback &callback : callbacks) cache.Deliver(key,callback);
+				return;
+			}
+
+			const QByteArray data=reply->readAll();
+			cache.Forget(key); // whatever we decoded before is out of date now
+			cache.Store(key,data,reply);
+			for (const Callback &callback : callbacks) callback(data,{});
+		},{},headers,{},priority);
+	}
+
+	void Cache::Image(const QUrl &url,QObject *context,ImageCallback callback,const QSize &bounds)
+	{
+		Cache &cache=Instance();
+		const QString key=Key(url);
+		const QString decodedKey=bounds.isValid() ? QString("%1@%2x%3").arg(key,StringConvert::Integer(bounds.width()),StringConvert::Integer(bounds.height())) : key;
+		if (const QImage *image=cache.images.object(decodedKey); image)
+		{
+			// callers expect to hear back later, the same as if it had been downloaded
+			QTimer::singleShot(0,context,[image=*image,callback]() {
+				callback(image,{});
+			});
+			return;
+		}
+
+		Fetch(url,[context=QPointer<QObject>(context),decodedKey,bounds,callback](const QByteArray &data,const QString &error) {
+			if (!context) return; // whoever asked isn't around to show it anymore
+			if (!error.isEmpty())
+			{
+				callback({},error);
+				return;
+			}
+			Decoder::Image(data,context,[decodedKey,callback](const QImage &image) {
+				if (image.isNull())
+				{
+					callback({},"Not a readable image");
+					return;
+				}
+				Instance().images.insert(decodedKey,new QImage(image),std::max<qint64>(1,image.sizeInBytes()/1024));
+				callback(image,{});
+			},bounds);
+		});
+	}
+
+	void Cache::Deliver(const QString &key,Callback callback)
+	{
+		Entry &entry=entries.at(key);
+		entry.accessed=QDateTime::currentSecsSinceEpoch();
+		saveDelay.start();
+
+		QTimer::singleShot(0,this,[this,key,callback]() {
+			QFile file(directory.filePath(key));
+			if (!file.open(QIODevice::ReadOnly))
+			{
+				// someone cleaned up behind our back, so forget about it
+				if (auto entry=entries.find(key); entry != entries.end())
+				{
+					total-=entry->second.size;
+					entries.erase(entry);
+				}
+				callback({},QString("Failed to open cached file %1").arg(file.fileName()));
+				return;
+			}
+			callback(file.readAll(),{});
+		});
+	}
+
+	void Cache::Store(const QString &key,const QByteArray &data,const QNetworkReply *reply)
+	{
+		QSaveFile file(directory.filePath(key));
+		if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) return; // still usable this time, just not next time
+
+		const qint64 now=QDateTime::currentSecsSinceEpoch();
+		auto [entry,inserted]=entries.try_emplace(key,Entry{});
+		if (!inserted) total-=entry->second.size;
+		entry->second={
+			.etag=reply->rawHeader("ETag"),
+			.modified=reply->rawHeader("Last-Modified"),
+			.size=data.size(),
+			.accessed=now,
+			.validated=now
+		};
+		total+=data.size();
+		if (total > budget) Evict();
+		saveDelay.start();
+	}
+
+	void Cache::Forget(const QString &key)
+	{
+		// decoded copies are keyed on the size they were decoded for too, so catch all of them
+		const QList<QString> decoded=images.keys();
+		for (const QString &candidate : decoded)
+		{
+			if (candidate.startsWith(key)) images.remove(candidate);
+		}
+	}
+
+	void Cache::Evict()
+	{
+		// least recently used first, and clear a little extra so we're not back here on the next download
+		std::vector<std::pair<qint64,QString>> candidates;
+		candidates.reserve(entries.size());
+		for (const auto &[key,entry] : entries) candidates.emplace_back(entry.accessed,key);
+		std::sort(candidates.begin(),candidates.end());
+		const qint64 target=budget-budget/10;
+		evictions++;
+		for (const auto &[accessed,key] : candidates)
+		{
+			if (total <= target) break;
+			directory.remove(key);
+			Forget(key);
+			total-=entries.at(key).size;
+			entries.erase(key);
+		}
+	}
+
+	void Cache::Load()
+	{
+		QFile indexFile(directory.filePath(CACHE_INDEX_FILENAME));
+		QJsonObject index;
+		if (indexFile.open(QIODevice::ReadOnly))
+		{
+			if (const JSON::ParseResult parsedJSON=JSON::Parse(indexFile.readAll()); parsedJSON) index=parsedJSON().object();
+		}
+
+		// the files themselves are the final word on what's here, and the index just fills in the details
+		const QFileInfoList files=directory.entryInfoList(QDir::Files);
+		for (const QFileInfo &file : files)
+		{
+			const QString key=file.fileName();
+			if (key == CACHE_INDEX_FILENAME) continue;
+			const QJsonObject details=index.value(key).toObject();
+			entries.try_emplace(key,Entry{
+				.etag=details.value(CACHE_KEY_ETAG).toString().toLatin1(),
+				.modified=details.value(CACHE_KEY_MODIFIED).toString().toLatin1(),
+				.size=file.size(),
+				.accessed=details.contains(CACHE_KEY_ACCESSED) ? details.value(CACHE_KEY_ACCESSED).toInteger() : file.lastModified().toSecsSinceEpoch(),
+				.validated=details.value(CACHE_KEY_VALIDATED).toInteger()
+			});
+			total+=file.size();
+		}
+		if (total > budget) Evict();
+	}
+
+	void Cache::Save()
+	{
+		QJsonObject index;
+		for (const auto &[key,entry] : entries)
+		{
+			index.insert(key,QJsonObject{
+				{CACHE_KEY_ETAG,QString::fromLatin1(entry.etag)},
+				{CACHE_KEY_MODIFIED,QString::fromLatin1(entry.modified)},
+				{CACHE_KEY_ACCESSED,entry.accessed},
+				{CACHE_KEY_VALIDATED,entry.validated}
+			});
+		}
+		QSaveFile indexFile(directory.filePath(CACHE_INDEX_FILENAME));
+		if (indexFile.open(QIODevice::WriteOnly)) indexFile.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+		indexFile.commit();
+	}
+}
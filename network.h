@@ -3,7 +3,13 @@
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QUrlQuery>
+#include <QImage>
+#include <QCache>
+#include <QTimer>
+#include <QDir>
+#include <QPointer>
 #include <queue>
+#include <unordered_map>
 
 namespace Network
 {
@@ -21,6 +27,12 @@ namespace Network
 		DELETE
 	};
 
+	enum class Priority
+	{
+		NORMAL,
+		LOW //! only goes out once nothing else is waiting
+	};
+
 	struct Header
 	{
 		QByteArray key;
@@ -33,23 +45,68 @@ namespace Network
 	{
 		Q_OBJECT
 	public:
-		static Request* Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters=QUrlQuery{},const Headers &headers=Headers{},const QByteArray &payload=QByteArray{});
+		static Request* Send(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters=QUrlQuery{},const Headers &headers=Headers{},const QByteArray &payload=QByteArray{},Priority priority=Priority::NORMAL);
 	private:
-		Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload);
+		Request(const QUrl &url,Method method,Callback callback,const QUrlQuery &queryParameters,const Headers &headers,const QByteArray &payload,Priority priority);
 		QUrl url;
 		Method method;
 		Callback callback;
 		QUrlQuery queryParameters;
 		Headers headers;
 		QByteArray payload;
+		Priority priority;
 		QNetworkRequest request;
 		QNetworkReply *reply;
 		static std::unique_ptr<QNetworkAccessManager> networkManager;
 		static std::queue<Request*> queue;
+		static std::queue<Request*> background; //! low priority requests waiting for the queue to empty
 		void Send();
 		void DeferredSend();
 	private slots:
 		void Finished();
 		void DeferredFinished();
 	};
-}
\ No newline at end of file
+
+	// Downloaded images, kept as the bytes we were sent under the data path and named
+	// for a hash of where they came from. Anything we've already decoded recently is
+	// kept in memory in front of that, so it doesn't have to be read or decoded again.
+	class Cache final : public QObject
+	{
+		Q_OBJECT
+	public:
+		using Callback=std::function<void(const QByteArray &data,const QString &error)>;
+		using ImageCallback=std::function<void(const QImage &image,const QString &error)>;
+		static void Fetch(const QUrl &url,Callback callback,Priority priority=Priority::NORMAL);
+		static void Image(const QUrl &url,QObject *context,ImageCallback callback,const QSize &bounds=QSize());
+		static QString Path(const QUrl &url);
+		static bool Contains(const QUrl &url);
+		static quint64 Evictions();
+	private:
+		struct Entry
+		{
+			QByteArray etag;
+			QByteArray modified; //! Last-Modified, exactly as the server sent it
+			qint64 size;
+			qint64 accessed;
+			qint64 validated; //! when the server last told us this was still current
+		};
+		Cache();
+		QDir directory;
+		std::unordered_map<QString,Entry> entries;
+		qint64 total;
+		qint64 budget;
+		quint64 evictions; //! bumped whenever files are thrown out, so anyone remembering what's on disk knows to look again
+		QCache<QString,QImage> images; //! cost is in kilobytes
+		std::unordered_map<QString,std::vector<Callback>> inflight; //! everyone waiting on a download that's already underway
+		QTimer saveDelay;
+		static QPointer<Cache> instance; //! owned by the application, so it's still around to save its index on the way out
+		static Cache& Instance();
+		static QString Key(const QUrl &url);
+		void Load();
+		void Save();
+		void Deliver(const QString &key,Callback callback);
+		void Store(const QString &key,const QByteArray &data,const QNetworkReply *reply);
+		void Forget(const QString &key);
+		void Evict();
+	};
+}
@@ -95,7 +95,7 @@ ChatPane::ChatPane(QWidget *parent) : PersistentPane(parent),
 	agenda->hide();
 	layout()->addWidget(agenda);
 
-	chat=new PinnedTextEdit(this);
+	chat=new PinnedTextEdit(this,Chat::SCROLLBACK);
 	chat->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	chat->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	chat->setFrameStyle(QFrame::NoFrame);
@@ -185,14 +185,24 @@ void ChatPane::Message(std::shared_ptr<Chat::Message> message) const
 	}
 
 	if (message->action)
-		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1 <span class='message'>%2</span></div>").arg(message->displayName,message->text,message->color.isValid() ? message->color.name() : settingForegroundColor,badges),message->id);
+		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1 <span class='message'>%2</span></div>").arg(message->displayName,message->text,message->color.isValid() ? message->color.name() : settingForegroundColor,badges),message->id,message->pending);
 	else
-		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1</div><div class='message'>%2</div>").arg(message->displayName,message->text,message->color.isValid() ? message->color.name() : settingForegroundColor,badges),message->id);
+		chat->Append(QString("<div>%4</div><div class='user' style='color: %3;'>%1</div><div class='message'>%2</div>").arg(message->displayName,message->text,message->color.isValid() ? message->color.name() : settingForegroundColor,badges),message->id,message->pending);
 }
 
-void ChatPane::DeleteMessage(const QString &id)
+void ChatPane::DeleteMessages(const QStringList &ids)
 {
-	chat->Remove(id);
+	chat->Remove(ids);
+}
+
+void ChatPane::Asset(const QString &path,const QImage &image)
+{
+	chat->Resource(path,image);
+}
+
+void ChatPane::AssetFailed(const QString &path)
+{
+	chat->Abandon(path);
 }
 
 void ChatPane::Print(const QString &text)
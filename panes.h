@@ -86,7 +86,9 @@ public slots:
 	void Refresh();
 	void Print(const QString &text) override;
 	void Message(std::shared_ptr<Chat::Message> message) const;
-	void DeleteMessage(const QString &id);
+	void DeleteMessages(const QStringList &ids);
+	void Asset(const QString &path,const QImage &image);
+	void AssetFailed(const QString &path);
 protected slots:
 	void DismissStatus();
 };
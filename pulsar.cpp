@@ -7,6 +7,7 @@
 #include "globals.h"
 
 const char *TRIGGER_LIST_FILENAME="pulsar.json";
+const std::chrono::milliseconds TRIGGER_LIST_RELOAD_DELAY(250);
 const char *JSON_KEY_TRIGGER="trigger";
 const char *JSON_KEY_COMMAND="command";
 const char *JSON_KEY_SOURCES="sources";
@@ -24,6 +25,17 @@ Pulsar::Pulsar() : socket(new QLocalSocket(this)),
 
 	connect(socket,&QLocalSocket::readyRead,this,&Pulsar::Data);
 	connect(socket,&QLocalSocket::errorOccurred,this,&Pulsar::Error);
+
+	triggersReload.setSingleShot(true);
+	triggersReload.setInterval(TRIGGER_LIST_RELOAD_DELAY);
+	connect(&triggersReload,&QTimer::timeout,this,[this]() {
+		// if it's gone, it's probably halfway through being replaced, and the directory watch will bring us back
+		if (QFile::exists(Filesystem::DataPath().filePath(TRIGGER_LIST_FILENAME))) LoadTriggers();
+	});
+	connect(&triggersWatcher,&QFileSystemWatcher::fileChanged,&triggersReload,QOverload<>::of(&QTimer::start));
+	connect(&triggersWatcher,&QFileSystemWatcher::directoryChanged,this,[this]() {
+		if (const QString path=Filesystem::DataPath().filePath(TRIGGER_LIST_FILENAME); QFile::exists(path) && !triggersWatcher.files().contains(path)) triggersReload.start();
+	});
 }
 
 bool Pulsar::LoadTriggers()
@@ -37,6 +49,10 @@ bool Pulsar::LoadTriggers()
 		return false;
 	}
 
+	// editors tend to save by replacing the file, which drops it from the watcher
+	if (!triggersWatcher.files().contains(operationListFile.fileName())) triggersWatcher.addPath(operationListFile.fileName());
+	if (triggersWatcher.directories().isEmpty()) triggersWatcher.addPath(Filesystem::DataPath().absolutePath());
+
 	const JSON::ParseResult parsedJSON=JSON::Parse(operationListFile.readAll());
 	if (!parsedJSON)
 	{
@@ -44,6 +60,10 @@ bool Pulsar::LoadTriggers()
 		return false;
 	}
 
+	// build everything off to the side, so a bad edit leaves the triggers we already had in place
+	std::unordered_map<QString,QJsonArray> stagedTriggers;
+	std::unordered_map<QString,QSize> stagedDimensions;
+	std::unordered_map<QString,QString> stagedCommandCrossReference;
 	const QJsonArray objects=parsedJSON().array();
 	for (const QJsonValue &jsonValue : objects)
 	{
@@ -64,7 +84,7 @@ bool Pulsar::LoadTriggers()
 					continue;
 				}
 
-				dimensions.try_emplace(jsonFieldScene->toString(),jsonFieldDimensionsX->toInt(),jsonFieldDimensionsY->toInt());
+				stagedDimensions.try_emplace(jsonFieldScene->toString(),jsonFieldDimensionsX->toInt(),jsonFieldDimensionsY->toInt());
 				continue;
 			}
 		}
@@ -84,13 +104,16 @@ bool Pulsar::LoadTriggers()
 		}
 
 		const QString name=jsonFieldTrigger->toString();
-		if (triggers.try_emplace(name,jsonFieldSources->toArray()).second)
+		if (stagedTriggers.try_emplace(name,jsonFieldSources->toArray()).second)
 		{
 			auto jsonFieldCommand=jsonObjectTrigger.find(JSON_KEY_COMMAND);
-			if (jsonFieldCommand != jsonObjectTrigger.end()) commandCrossReference.try_emplace(name,jsonFieldCommand->toString());
+			if (jsonFieldCommand != jsonObjectTrigger.end()) stagedCommandCrossReference.try_emplace(name,jsonFieldCommand->toString());
 		}
 	}
 
+	triggers.swap(stagedTriggers);
+	dimensions.swap(stagedDimensions);
+	commandCrossReference.swap(stagedCommandCrossReference);
 	return true;
 }
 
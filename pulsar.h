@@ -2,6 +2,7 @@
 #include <QJsonArray>
 #include <QLocalSocket>
 #include <QTimer>
+#include <QFileSystemWatcher>
 #include "settings.h"
 
 inline const char *PULSAR_SOCKET_NAME="pulsar-obs";
@@ -21,6 +22,8 @@ protected:
 	std::unordered_map<QString,QString> commandCrossReference;
 	QLocalSocket *socket;
 	QTimer reconnectDelay;
+	QFileSystemWatcher triggersWatcher;
+	QTimer triggersReload; //! editors save in several steps, so wait for them to settle before reading
 	ApplicationSetting settingEnabled;
 	ApplicationSetting settingReconnectDelay;
 signals:
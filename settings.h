@@ -45,6 +45,7 @@ public:
 	operator QSize() const { return source->value(name,defaultValue).toSize(); }
 	operator QByteArray() const { return Value().toString().toLocal8Bit(); }
 	operator QUrl() const { return Value().toUrl(); }
+	operator QStringList() const { return Value().toStringList(); }
 protected:
 	QString name;
 	QVariant defaultValue;
@@ -0,0 +1,240 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QThread>
+#include <QTextStream>
+#include <algorithm>
+#include "standin.h"
+#include "channel.h"
+#include "bot.h"
+#include "panes.h"
+#include "security.h"
+#include "settings.h"
+
+// Runs the real Channel, Bot, and ChatPane against a local stand-in for Twitch's
+// IRC server and reports how much chat they can keep up with, and how long each
+// message takes from the server's socket to the chat pane.
+//
+// Settings and data are kept under their own application name, so a soak never
+// touches the configuration, database, or logs of a real installation.
+
+const char *SOAK_APPLICATION_NAME="Celeste Soak";
+const char *SOAK_ORGANIZATION_NAME="EngineeringDeck";
+const char *SOAK_ADMINISTRATOR="celeste_soak";
+const char *SOAK_TRAFFIC_ROOM="#soak_traffic";
+const char *SOAK_SETTINGS_CATEGORY_CHANNEL="Channel"; //! has to match what Channel reads its settings from
+const qsizetype SOAK_SYNTHETIC_LINES=5000;
+const std::chrono::seconds SOAK_PROGRESS_INTERVAL(5);
+
+namespace Soak
+{
+	QTextStream& Out()
+	{
+		static QTextStream out(stdout);
+		return out;
+	}
+
+	// Mostly chat, in a spread of tag-heavy shapes, with the occasional message
+	// deleted by a moderator and the occasional subscription.
+	std::vector<QByteArray> Synthesize()
+	{
+		static const std::array<const char*,4> BADGES={"subscriber/12,premium/1","moderator/1,subscriber/3012","vip/1,bits/1000",""};
+		static const std::array<const char*,4> EMOTES={"25:0-4,12-16/1902:6-10","","305954156:0-7",""};
+		static const std::array<const char*,4> TEXT={"Kappa Keepo Kappa hello there","nice one chat <3 & such","PogChamp what a play","what's the song? it's really good and I want to add it to my own playlist for later"};
+
+		std::vector<QByteArray> script;
+		script.reserve(SOAK_SYNTHETIC_LINES);
+		for (qsizetype index=0; index < SOAK_SYNTHETIC_LINES; index++)
+		{
+			const QString viewer=QString("viewer%1").arg(index%2000);
+			if (index%97 == 96)
+			{
+				script.push_back(QString("@login=%1;room-id=1337;target-msg-id=;tmi-sent-ts=1507246572675 :tmi.twitch.tv CLEARMSG #channel :%2").arg(viewer,TEXT[index%TEXT.size()]).toUtf8());
+				continue;
+			}
+			if (index%251 == 250)
+			{
+				script.push_back(QString("@badge-info=subscriber/1;badges=subscriber/0;color=;display-name=%1;emotes=;id=;login=%1;mod=0;msg-id=sub;msg-param-cumulative-months=1;msg-param-sub-plan=1000;room-id=1337;subscriber=1;system-msg=%1\\ssubscribed\\sat\\sTier\\s1.;tmi-sent-ts=1507246572675;user-id=%2;user-type= :tmi.twitch.tv USERNOTICE #channel :%3").arg(viewer,QString::number(100000+index%2000),TEXT[index%TEXT.size()]).toUtf8());
+				continue;
+			}
+			const std::size_t variant=index%BADGES.size();
+			script.push_back(QString("@badge-info=subscriber/14;badges=%1;client-nonce=4f2b7e0c9d1a8e6f3b5c7d9e1f2a4b6c;color=#1E90FF;display-name=Viewer%2;emotes=%3;first-msg=0;flags=;id=;mod=0;returning-chatter=0;room-id=1337;subscriber=1;tmi-sent-ts=1507246572675;turbo=0;user-id=%4;user-type= :%5!%5@%5.tmi.twitch.tv PRIVMSG #channel :%6")
+				.arg(BADGES[variant],QString::number(index%2000),EMOTES[variant],QString::number(100000+index%2000),viewer,TEXT[variant]).toUtf8());
+		}
+		return script;
+	}
+
+	std::vector<QByteArray> Script(const QString &path)
+	{
+		if (path.isEmpty()) return Synthesize();
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			Out() << "Failed to open " << path << ", replaying synthetic traffic instead\n";
+			return Synthesize();
+		}
+
+		// only what the server says to a room is worth replaying, not its replies to us
+		std::vector<QByteArray> script;
+		for (QByteArray line : file.readAll().split('\n'))
+		{
+			if (line.endsWith('\r')) line.chop(1);
+			const IRC::Message message(line);
+			const QByteArrayView command=message.Command();
+			if (command == QByteArrayView("PRIVMSG") || command == QByteArrayView("CLEARMSG") || command == QByteArrayView("USERNOTICE")) script.push_back(line);
+		}
+		return script;
+	}
+
+	double Percentile(const std::vector<std::chrono::nanoseconds> &sorted,double percentile)
+	{
+		if (sorted.empty()) return 0;
+		const std::size_t index=std::min(sorted.size()-1,static_cast<std::size_t>(percentile/100.0*static_cast<double>(sorted.size())));
+		return static_cast<double>(sorted[index].count())/1e6;
+	}
+}
+
+int main(int argc,char *argv[])
+{
+	QApplication application(argc,argv);
+	application.setOrganizationName(SOAK_ORGANIZATION_NAME);
+	application.setApplicationName(SOAK_APPLICATION_NAME);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Drives Celeste's chat path with traffic from a local stand-in for Twitch's IRC server");
+	parser.addHelpOption();
+	QCommandLineOption optionRate("rate","Messages per second to send","messages","500");
+	QCommandLineOption optionDuration("duration","How long to send for, in seconds","seconds","60");
+	QCommandLineOption optionDisconnect("disconnect","Drop the connection this often, in seconds (0 to never)","seconds","0");
+	QCommandLineOption optionCapture("capture","Replay raw IRC lines from this file instead of synthetic traffic","file");
+	QCommandLineOption optionServe("serve","Send traffic to the room the bot serves, so commands and arrivals run too (these reach Twitch's API)");
+	QCommandLineOption optionVerbose("verbose","Print what the channel, bot, and stand-in report");
+	parser.addOptions({optionRate,optionDuration,optionDisconnect,optionCapture,optionServe,optionVerbose});
+	parser.process(application);
+	const double rate=parser.value(optionRate).toDouble();
+	const std::chrono::seconds duration(parser.value(optionDuration).toInt());
+	const std::chrono::seconds disconnectInterval(parser.value(optionDisconnect).toInt());
+	if (rate <= 0 || duration.count() <= 0)
+	{
+		Soak::Out() << "Rate and duration must both be more than zero\n";
+		return 1;
+	}
+
+	Security security;
+	if (!security.Administrator() || static_cast<QString>(security.Administrator()).isEmpty()) security.Administrator().Set(SOAK_ADMINISTRATOR);
+	if (!security.OAuthToken()) security.OAuthToken().Set("soak");
+
+	const QString administrator=static_cast<QString>(security.Administrator());
+	const QByteArray room=parser.isSet(optionServe) ? QString("#%1").arg(administrator.toLower()).toUtf8() : QByteArray(SOAK_TRAFFIC_ROOM);
+	StandIn standIn(Soak::Script(parser.value(optionCapture)),room);
+	standIn.Rate(rate);
+	standIn.DisconnectEvery(disconnectInterval);
+	QThread standInThread;
+	standIn.moveToThread(&standInThread);
+	standInThread.start();
+	quint16 port=0;
+	QMetaObject::invokeMethod(&standIn,[&standIn,&port]() {
+		if (standIn.listen(QHostAddress::LocalHost)) port=standIn.serverPort();
+	},Qt::BlockingQueuedConnection);
+	if (port == 0)
+	{
+		Soak::Out() << "Stand-in server failed to listen: " << standIn.errorString() << "\n";
+		standInThread.quit();
+		standInThread.wait();
+		return 1;
+	}
+
+	ApplicationSetting(SOAK_SETTINGS_CATEGORY_CHANNEL,"Name").Set(administrator);
+	ApplicationSetting(SOAK_SETTINGS_CATEGORY_CHANNEL,"Host").Set("127.0.0.1");
+	ApplicationSetting(SOAK_SETTINGS_CATEGORY_CHANNEL,"Port").Set(port);
+	ApplicationSetting(SOAK_SETTINGS_CATEGORY_CHANNEL,"Rooms").Set(parser.isSet(optionServe) ? QString() : QString(SOAK_TRAFFIC_ROOM));
+
+	std::vector<std::chrono::nanoseconds> latencies;
+	latencies.reserve(static_cast<std::size_t>(rate*static_cast<double>(duration.count())));
+	quint64 displayed=0;
+	quint64 reconnects=0;
+	{
+		Channel channel(security);
+		Music::Player musicPlayer(true,0);
+		Bot bot(musicPlayer,security);
+		ChatPane chatPane(nullptr);
+		chatPane.resize(400,800);
+		chatPane.show();
+
+		if (parser.isSet(optionVerbose))
+		{
+			channel.connect(&channel,&Channel::Print,&application,[](const QString &message,const QString &operation,const QString &subsystem) {
+				Soak::Out() << subsystem << " (" << operation << "): " << message << "\n";
+			});
+			bot.connect(&bot,&Bot::Print,&application,[](const QString &message,const QString &operation,const QString &subsystem) {
+				Soak::Out() << subsystem << " (" << operation << "): " << message << "\n";
+			});
+			standIn.connect(&standIn,&StandIn::Print,&application,[](const QString &message,const QString &operation,const QString &subsystem) {
+				Soak::Out() << subsystem << " (" << operation << "): " << message << "\n";
+			});
+		}
+		bot.Serve({channel.Room()}); // the traffic room is only watched, unless it was told to serve it
+		channel.connect(&channel,&Channel::Dispatch,&bot,&Bot::ParseChatMessage);
+		channel.connect(&channel,&Channel::Deleted,&bot,&Bot::ParseChatMessageDeletion);
+		bot.connect(&bot,&Bot::ChatMessage,&chatPane,&ChatPane::Message);
+		bot.connect(&bot,&Bot::DeleteChatMessages,&chatPane,&ChatPane::DeleteMessages);
+		bot.connect(&bot,&Bot::ChatAsset,&chatPane,&ChatPane::Asset);
+		bot.connect(&bot,&Bot::ChatAssetFailed,&chatPane,&ChatPane::AssetFailed);
+
+		// connected after the pane, so the clock stops once the message is on screen
+		bot.connect(&bot,&Bot::ChatMessage,&application,[&latencies,&displayed](std::shared_ptr<Chat::Message> message) {
+			std::optional<std::chrono::nanoseconds> sent=StandIn::Stamped(message->id);
+			if (!sent) return;
+			latencies.push_back(StandIn::Now()-*sent);
+			displayed++;
+		});
+		channel.connect(&channel,&Channel::Connected,&application,[&reconnects]() {
+			reconnects++;
+		});
+
+		QElapsedTimer elapsed;
+		QTimer progress;
+		progress.setInterval(SOAK_PROGRESS_INTERVAL);
+		quint64 lastDisplayed=0;
+		progress.connect(&progress,&QTimer::timeout,&application,[&displayed,&lastDisplayed,&elapsed]() {
+			Soak::Out() << QString::number(elapsed.elapsed()/1000) << "s: " << QString::number(static_cast<double>(displayed-lastDisplayed)/static_cast<double>(SOAK_PROGRESS_INTERVAL.count()),'f',0) << " messages/s\n";
+			Soak::Out().flush();
+			lastDisplayed=displayed;
+		});
+		channel.connect(&channel,&Channel::Joined,&application,[&standIn,&elapsed,&progress,&application,duration]() {
+			Soak::Out() << "Joined, sending traffic for " << duration.count() << "s\n";
+			Soak::Out().flush();
+			QMetaObject::invokeMethod(&standIn,&StandIn::Start,Qt::QueuedConnection);
+			elapsed.start();
+			progress.start();
+			QTimer::singleShot(duration,&application,[&standIn,&application]() {
+				QMetaObject::invokeMethod(&standIn,&StandIn::Stop,Qt::BlockingQueuedConnection);
+				QTimer::singleShot(std::chrono::seconds(1),&application,&QApplication::quit); // let whatever's still in flight land
+			});
+		},Qt::SingleShotConnection);
+
+		channel.Connect();
+		application.exec();
+
+		QMetaObject::invokeMethod(&standIn,[&standIn]() {
+			standIn.close();
+			standIn.Disconnect();
+		},Qt::BlockingQueuedConnection);
+		channel.Disconnect();
+		const double seconds=static_cast<double>(elapsed.isValid() ? elapsed.elapsed() : 0)/1000.0;
+
+		std::sort(latencies.begin(),latencies.end());
+		Soak::Out() << "\nSent " << standIn.Sent() << " chat messages, " << displayed << " reached the chat pane\n";
+		Soak::Out() << "Sustained " << QString::number(seconds > 0 ? static_cast<double>(displayed)/seconds : 0,'f',0) << " messages/s over " << QString::number(seconds,'f',1) << "s\n";
+		Soak::Out() << "Latency (ms): p50 " << QString::number(Soak::Percentile(latencies,50),'f',2)
+			<< ", p95 " << QString::number(Soak::Percentile(latencies,95),'f',2)
+			<< ", p99 " << QString::number(Soak::Percentile(latencies,99),'f',2)
+			<< ", max " << QString::number(latencies.empty() ? 0 : static_cast<double>(latencies.back().count())/1e6,'f',2) << "\n";
+		Soak::Out() << "Dropped the connection " << standIn.Disconnects() << " times, reconnected " << (reconnects > 0 ? reconnects-1 : 0) << " times\n";
+		Soak::Out().flush();
+	}
+
+	standInThread.quit();
+	standInThread.wait();
+	return 0;
+}
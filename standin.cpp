@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cmath>
+#include "standin.h"
+
+const char *STAND_IN_HOST="tmi.twitch.tv";
+const char *STAND_IN_ID_PREFIX="soak-";
+const char *OPERATION_STAND_IN_SESSION="session";
+const char *OPERATION_STAND_IN_REPLAY="replay";
+const std::chrono::milliseconds STAND_IN_TICK(5);
+
+StandIn::StandIn(std::vector<QByteArray> &&script,const QByteArray &room,QObject *parent) : QTcpServer(parent),
+	script(std::move(script)),
+	cursor(0),
+	room(room),
+	rate(0),
+	credit(0),
+	replayTimer(this),
+	disconnectTimer(this),
+	sequence(0),
+	sent(0),
+	disconnects(0)
+{
+	replayTimer.setTimerType(Qt::PreciseTimer);
+	replayTimer.setInterval(STAND_IN_TICK);
+	connect(&replayTimer,&QTimer::timeout,this,&StandIn::Replay);
+	connect(&disconnectTimer,&QTimer::timeout,this,&StandIn::Disconnect);
+}
+
+void StandIn::Rate(double messagesPerSecond)
+{
+	rate=messagesPerSecond;
+}
+
+void StandIn::DisconnectEvery(std::chrono::milliseconds interval)
+{
+	disconnectTimer.setInterval(interval);
+}
+
+void StandIn::Start()
+{
+	if (script.empty())
+	{
+		emit Print("Nothing to replay",OPERATION_STAND_IN_REPLAY);
+		return;
+	}
+	credit=0;
+	replayClock.start();
+	replayTimer.start();
+	if (disconnectTimer.interval() > 0) disconnectTimer.start();
+}
+
+void StandIn::Stop()
+{
+	replayTimer.stop();
+	disconnectTimer.stop();
+}
+
+void StandIn::incomingConnection(qintptr descriptor)
+{
+	QTcpSocket *socket=new QTcpSocket(this);
+	if (!socket->setSocketDescriptor(descriptor))
+	{
+		emit Print(QString("Failed to accept connection (%1)").arg(socket->errorString()),OPERATION_STAND_IN_SESSION);
+		delete socket;
+		return;
+	}
+	socket->setSocketOption(QAbstractSocket::LowDelayOption,1); // Twitch doesn't hold lines back to fill packets, so neither should we
+	clients.try_emplace(socket);
+	connect(socket,&QTcpSocket::readyRead,this,[this,socket]() {
+		Read(socket);
+	});
+	connect(socket,&QTcpSocket::disconnected,this,[this,socket]() {
+		clients.erase(socket);
+		socket->deleteLater();
+	});
+}
+
+void StandIn::Read(QTcpSocket *socket)
+{
+	auto candidate=clients.find(socket);
+	if (candidate == clients.end()) return;
+	Client &client=candidate->second;
+	client.framer.Fill(*socket);
+	while (std::optional<QByteArrayView> line=client.framer.Line())
+	{
+		const IRC::Message message(*line);
+		if (message.Valid()) Respond(socket,client,message);
+	}
+}
+
+void StandIn::Respond(QTcpSocket *socket,Client &client,const IRC::Message &message)
+{
+	const QByteArrayView command=message.Command();
+	const QByteArray host(STAND_IN_HOST);
+
+	if (command == QByteArrayView("NICK"))
+	{
+		client.nick=message.Parameter(0).value_or(QByteArrayView{}).toByteArray();
+		socket->write(":"+host+" 001 "+client.nick+" :Welcome, GLHF!\r\n"
+			":"+host+" 002 "+client.nick+" :Your host is "+host+"\r\n"
+			":"+host+" 003 "+client.nick+" :This server is rather new\r\n"
+			":"+host+" 004 "+client.nick+" :-\r\n"
+			":"+host+" 375 "+client.nick+" :-\r\n"
+			":"+host+" 372 "+client.nick+" :You are in a maze of twisty passages, all alike.\r\n"
+			":"+host+" 376 "+client.nick+" :>\r\n");
+		emit Print(QString("%1 logged in").arg(QString::fromUtf8(client.nick)),OPERATION_STAND_IN_SESSION);
+		return;
+	}
+
+	if (command == QByteArrayView("CAP"))
+	{
+		socket->write(":"+host+" CAP * ACK :"+message.Trailing().value_or(QByteArrayView{}).toByteArray()+"\r\n");
+		return;
+	}
+
+	if (command == QByteArrayView("JOIN"))
+	{
+		const QByteArray hostmask=client.nick+"!"+client.nick+"@"+client.nick+"."+host;
+		QByteArray reply;
+		for (const QByteArray &joined : message.Parameter(0).value_or(QByteArrayView{}).toByteArray().split(','))
+		{
+			if (joined.isEmpty()) continue;
+			client.rooms.push_back(joined);
+			reply.append(":"+hostmask+" JOIN "+joined+"\r\n"
+				":"+client.nick+"."+host+" 353 "+client.nick+" = "+joined+" :"+client.nick+"\r\n"
+				":"+client.nick+"."+host+" 366 "+client.nick+" "+joined+" :End of /NAMES list\r\n");
+		}
+		socket->write(reply);
+		return;
+	}
+
+	if (command == QByteArrayView("PART"))
+	{
+		const QByteArrayView parted=message.Parameter(0).value_or(QByteArrayView{});
+		std::erase_if(client.rooms,[parted](const QByteArray &joined) {
+			return QByteArrayView(joined) == parted;
+		});
+		return;
+	}
+
+	if (command == QByteArrayView("PING"))
+	{
+		socket->write(":"+host+" PONG "+host+" :"+message.Trailing().value_or(QByteArrayView{}).toByteArray()+"\r\n");
+		return;
+	}
+
+	// PASS, and anything the client says in chat, needs no answer
+}
+
+void StandIn::Replay()
+{
+	std::vector<QTcpSocket*> listeners;
+	for (const auto &[socket,client] : clients)
+	{
+		if (std::find(client.rooms.begin(),client.rooms.end(),room) != client.rooms.end()) listeners.push_back(socket);
+	}
+
+	// a late tick makes up for lost time, but traffic doesn't pile up while nobody's listening
+	credit+=rate*static_cast<double>(replayClock.nsecsElapsed())/1e9;
+	replayClock.restart();
+	if (listeners.empty())
+	{
+		credit=0;
+		return;
+	}
+	credit=std::min(credit,std::max(rate,1.0));
+	const qint64 count=static_cast<qint64>(std::floor(credit));
+	if (count < 1) return;
+	credit-=static_cast<double>(count);
+
+	QByteArray batch;
+	for (qint64 index=0; index < count; index++) batch.append(Rewrite(script[cursor++%script.size()]));
+	for (QTcpSocket *socket : listeners) socket->write(batch);
+}
+
+void StandIn::Disconnect()
+{
+	// aborting emits disconnected(), which takes the client out of the table we'd be walking
+	std::vector<QTcpSocket*> sockets;
+	for (const auto &[socket,client] : clients) sockets.push_back(socket);
+	for (QTcpSocket *socket : sockets) socket->abort();
+	if (sockets.empty()) return;
+	disconnects++;
+	emit Print(QString("Dropped %1 connections").arg(sockets.size()),OPERATION_STAND_IN_SESSION);
+}
+
+QByteArray StandIn::Rewrite(const QByteArray &line)
+{
+	// every line goes to our room, whatever room it was recorded in, and gets
+	// an ID that says when it was sent, so latency can be read straight off of it
+	const IRC::Message message(line);
+	if (!message.Valid()) return {};
+	const QByteArrayView command=message.Command();
+	const bool chat=command == QByteArrayView("PRIVMSG");
+	const bool deletion=command == QByteArrayView("CLEARMSG");
+
+	QByteArray id;
+	if (chat || command == QByteArrayView("USERNOTICE")) id=Stamp(sequence++);
+	if (chat)
+	{
+		lastID=id;
+		sent++;
+	}
+
+	QByteArray tags;
+	bool stamped=false;
+	QByteArrayView window=message.Tags();
+	while (!window.isEmpty())
+	{
+		const qsizetype delimiter=window.indexOf(';');
+		const QByteArrayView pair=delimiter < 0 ? window : window.first(delimiter);
+		window=delimiter < 0 ? QByteArrayView{} : window.sliced(delimiter+1);
+		if (!tags.isEmpty()) tags.append(';');
+		if (!id.isEmpty() && pair.startsWith("id="))
+		{
+			tags.append("id="+id);
+			stamped=true;
+		}
+		else if (deletion && pair.startsWith("target-msg-id="))
+		{
+			tags.append("target-msg-id="+lastID);
+		}
+		else
+		{
+			tags.append(pair);
+		}
+	}
+	if (!id.isEmpty() && !stamped) tags.append(QByteArray(tags.isEmpty() ? "" : ";")+"id="+id);
+
+	QByteArray rewritten;
+	rewritten.reserve(line.size()+64);
+	if (!tags.isEmpty()) rewritten.append("@"+tags+" ");
+	if (!message.Source().isEmpty()) rewritten.append(":"+message.Source().toByteArray()+" ");
+	rewritten.append(command);
+	rewritten.append(" "+room);
+	QByteArrayView parameters=message.Parameters();
+	if (const qsizetype delimiter=parameters.indexOf(' '); delimiter >= 0) rewritten.append(parameters.sliced(delimiter)); // the room is always the first parameter
+	if (std::optional<QByteArrayView> trailing=message.Trailing(); trailing) rewritten.append(" :"+trailing->toByteArray());
+	rewritten.append("\r\n");
+	return rewritten;
+}
+
+QByteArray StandIn::Stamp(qint64 sequence)
+{
+	return STAND_IN_ID_PREFIX+QByteArray::number(sequence)+"-"+QByteArray::number(static_cast<qint64>(Now().count()));
+}
+
+std::optional<std::chrono::nanoseconds> StandIn::Stamped(QStringView id)
+{
+	if (!id.startsWith(QLatin1StringView(STAND_IN_ID_PREFIX))) return std::nullopt;
+	bool valid=false;
+	const qint64 sent=id.sliced(id.lastIndexOf('-')+1).toLongLong(&valid);
+	if (!valid) return std::nullopt;
+	return std::chrono::nanoseconds(sent);
+}
+
+std::chrono::nanoseconds StandIn::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "irc.h"
+
+// Just enough of irc.chat.twitch.tv to log in, join rooms, and be talked at,
+// so Channel and everything downstream of it can be exercised without Twitch.
+// Lines from the script are replayed into one room at a fixed rate, each one
+// stamped with the time it went out so the other end can tell how long it took.
+class StandIn : public QTcpServer
+{
+	Q_OBJECT
+public:
+	StandIn(std::vector<QByteArray> &&script,const QByteArray &room,QObject *parent=nullptr);
+	void Rate(double messagesPerSecond);
+	void DisconnectEvery(std::chrono::milliseconds interval);
+	quint64 Sent() const { return sent; }
+	quint64 Disconnects() const { return disconnects; }
+	static QByteArray Stamp(qint64 sequence);
+	static std::optional<std::chrono::nanoseconds> Stamped(QStringView id);
+	static std::chrono::nanoseconds Now();
+protected:
+	struct Client
+	{
+		IRC::Framer framer;
+		QByteArray nick;
+		std::vector<QByteArray> rooms;
+	};
+	std::vector<QByteArray> script;
+	std::size_t cursor;
+	QByteArray room;
+	double rate;
+	double credit; //! fractions of a message owed since the last tick
+	QTimer replayTimer;
+	QElapsedTimer replayClock;
+	QTimer disconnectTimer;
+	std::unordered_map<QTcpSocket*,Client> clients;
+	QByteArray lastID; //! CLEARMSGs in the script delete whatever went out just before them
+	qint64 sequence;
+	quint64 sent;
+	quint64 disconnects;
+	void incomingConnection(qintptr descriptor) override;
+	void Read(QTcpSocket *socket);
+	void Respond(QTcpSocket *socket,Client &client,const IRC::Message &message);
+	QByteArray Rewrite(const QByteArray &line);
+signals:
+	void Print(const QString &message,const QString operation=QString(),const QString subsystem=QString("stand-in"));
+public slots:
+	void Start();
+	void Stop();
+	void Replay();
+	void Disconnect();
+};
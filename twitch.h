@@ -13,6 +13,8 @@ namespace Twitch
 	inline const char *ENDPOINT_GAME_INFORMATION="games";
 	inline const char *ENDPOINT_USER_FOLLOWS="channels/followers";
 	inline const char *ENDPOINT_BADGES="chat/badges/global";
+	inline const char *ENDPOINT_CHANNEL_BADGES="chat/badges";
+	inline const char *ENDPOINT_CHANNEL_EMOTES="chat/emotes";
 	inline const char *ENDPOINT_SHOUTOUTS="chat/shoutouts";
 	inline const char *ENDPOINT_USERS="users";
 	inline const char *ENDPOINT_EVENTSUB="eventsub/subscriptions";
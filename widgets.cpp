@@ -39,8 +39,10 @@ void StaticTextEdit::contextMenuEvent(QContextMenuEvent *event)
 	emit ContextMenu(event);
 }
 
-PinnedTextEdit::PinnedTextEdit(QWidget *parent) : QTextEdit(parent), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
+PinnedTextEdit::PinnedTextEdit(QWidget *parent,std::size_t scrollback) : QTextEdit(parent), scrollback(scrollback), scrollTransition(QPropertyAnimation(verticalScrollBar(),"sliderPosition"))
 {
+	document()->setUndoRedoEnabled(false); // nobody types in here, so there's nothing to undo and a lot of history to keep
+
 	connect(&scrollTransition,&QPropertyAnimation::finished,this,&PinnedTextEdit::Tail);
 	connect(verticalScrollBar(),&QScrollBar::rangeChanged,this,&PinnedTextEdit::Scroll);
 }
@@ -71,7 +73,7 @@ void PinnedTextEdit::Tail()
 }
 
 
-void PinnedTextEdit::Append(const QString &text,const QString &id)
+void PinnedTextEdit::Append(const QString &text,const QString &id,const QStringList &pending)
 {
 	Tail();
 	QTextCursor cursor=document()->rootFrame()->lastCursorPosition();
@@ -79,6 +81,64 @@ void PinnedTextEdit::Append(const QString &text,const QString &id)
 	format.setBorderStyle(QTextFrameFormat::BorderStyle_None);
 	frames.try_emplace(id,cursor.insertFrame(format));
 	cursor.insertHtml(text);
+	for (const QString &path : pending) waiting[path].append(id);
+	if (!pending.isEmpty()) awaiting.try_emplace(id,pending);
+
+	// trim by what's actually shown, since messages deleted from chat have already
+	// taken their frames with them and only left their IDs behind in here
+	order.push_back(id);
+	while (frames.size() > scrollback && !order.empty())
+	{
+		Remove(order.front()); // does nothing for an ID that's already gone
+		order.pop_front();
+	}
+}
+
+void PinnedTextEdit::Remove(const QStringList &ids)
+{
+	// one repaint for the lot, however many messages went
+	setUpdatesEnabled(false);
+	QTextCursor batch(document());
+	batch.beginEditBlock();
+	for (const QString &id : ids) Remove(id);
+	batch.endEditBlock();
+	setUpdatesEnabled(true);
+}
+
+void PinnedTextEdit::Resource(const QString &path,const QImage &image)
+{
+	// hand the document the image directly, then only lay out again the messages
+	// that were waiting on it rather than the whole scrollback
+	document()->addResource(QTextDocument::ImageResource,QUrl(path),image);
+	for (const QString &id : Release(path))
+	{
+		auto frame=frames.find(id);
+		if (frame == frames.end()) continue;
+		const int start=frame->second->firstPosition();
+		document()->markContentsDirty(start,frame->second->lastPosition()-start);
+	}
+}
+
+void PinnedTextEdit::Abandon(const QString &path)
+{
+	// the download failed, so there's nothing coming to redraw those messages with
+	Release(path);
+}
+
+QStringList PinnedTextEdit::Release(const QString &path)
+{
+	auto candidate=waiting.find(path);
+	if (candidate == waiting.end()) return {};
+	const QStringList ids=std::move(candidate->second);
+	waiting.erase(candidate);
+	for (const QString &id : ids)
+	{
+		auto images=awaiting.find(id);
+		if (images == awaiting.end()) continue;
+		images->second.removeOne(path);
+		if (images->second.isEmpty()) awaiting.erase(images);
+	}
+	return ids;
 }
 
 void PinnedTextEdit::Remove(const QString &id)
@@ -91,6 +151,18 @@ void PinnedTextEdit::Remove(const QString &id)
 	cursor.select(QTextCursor::BlockUnderCursor);
 	cursor.removeSelectedText();
 	frames.erase(frame);
+
+	// nothing left to redraw once its images do show up
+	auto images=awaiting.find(id);
+	if (images == awaiting.end()) return;
+	for (const QString &path : images->second)
+	{
+		auto candidate=waiting.find(path);
+		if (candidate == waiting.end()) continue;
+		candidate->second.removeOne(id);
+		if (candidate->second.isEmpty()) waiting.erase(candidate);
+	}
+	awaiting.erase(images);
 }
 
 const int ScrollingTextEdit::PAUSE=5000;
@@ -378,6 +450,7 @@ namespace UI
 			duplicates=command.Duplicates();
 			message=command.Message();
 			triggers=command.Viewers();
+			limits=command.Limits();
 
 			switch (command.Type())
 			{
@@ -519,6 +592,11 @@ namespace UI
 			return protect;
 		}
 
+		const Cooldown::Policy& Entry::Limits() const
+		{
+			return limits;
+		}
+
 		void Entry::UpdateProtect(int state)
 		{
 			protect=state == Qt::Checked;
@@ -1095,7 +1173,8 @@ namespace UI
 					entry->Filters(),
 					entry->Message(),
 					entry->Triggers(),
-					entry->Protected()
+					entry->Protected(),
+					entry->Limits()
 				);
 
 				const auto aliases=entry->Aliases();
@@ -2074,40 +2153,81 @@ namespace UI
 	{
 		Dialog::Dialog(QWidget *parent) : QDialog(parent,Qt::Dialog|Qt::CustomizeWindowHint|Qt::WindowTitleHint|Qt::WindowCloseButtonHint),
 			layout(this),
-			users(this)
+			users(this),
+			traffic(this)
 		{
 			layout.addWidget(&users);
+			layout.addWidget(&traffic);
 			setModal(false);
 			setSizeGripEnabled(true);
 		}
 
-		void Dialog::Joined(const QString &user)
+		void Dialog::Joined(const QStringList &batch)
 		{
-			QListWidgetItem *item=new QListWidgetItem(user);
-			users.addItem(item);
-			item->setForeground(palette().mid());
+			QStringList arrivals;
+			arrivals.reserve(batch.size());
+			for (const QString &user : batch)
+			{
+				if (!index.contains(user)) arrivals.append(user);
+			}
+			if (arrivals.isEmpty()) return;
+
+			users.setUpdatesEnabled(false);
+			const int first=users.count();
+			users.addItems(arrivals);
+			const QBrush unacknowledged=palette().mid();
+			for (int row=first; row < users.count(); row++)
+			{
+				QListWidgetItem *item=users.item(row);
+				item->setForeground(unacknowledged);
+				index[item->text()]=item;
+			}
+			users.setUpdatesEnabled(true);
 			UpdateTitle();
 		}
 
 		void Dialog::Acknowledged(const QString &name)
 		{
-			QList<QListWidgetItem*> items=users.findItems(name,Qt::MatchExactly);
-			if (items.isEmpty()) return;
-			QListWidgetItem *item=items.at(0);
-			item->setForeground(palette().text());
+			auto candidate=index.find(name);
+			if (candidate == index.end()) return;
+			candidate->second->setForeground(palette().text());
 		}
 
-		void Dialog::Parted(const QString &user)
+		void Dialog::Parted(const QStringList &batch)
 		{
-			const auto items=users.findItems(user,Qt::MatchExactly);
-			for (QListWidgetItem *item : items) delete users.takeItem(users.row(item));
+			users.setUpdatesEnabled(false);
+			for (const QString &user : batch)
+			{
+				auto candidate=index.find(user);
+				if (candidate == index.end()) continue;
+				delete candidate->second; // deleting an item removes it from its list widget
+				index.erase(candidate);
+			}
+			users.setUpdatesEnabled(true);
 			UpdateTitle();
 		}
 
+		void Dialog::Outbound(qsizetype queued,quint64 sent,quint64 dropped)
+		{
+			outbound=QStringLiteral("Outbound: %1 queued, %2 sent, %3 dropped").arg(QString::number(queued),QString::number(sent),QString::number(dropped));
+			UpdateTraffic();
+		}
+
+		void Dialog::Inbound(std::size_t waiting,quint64 stalls)
+		{
+			inbound=QStringLiteral("Inbound: %1 waiting, %2 stalls").arg(QString::number(waiting),QString::number(stalls));
+			UpdateTraffic();
+		}
+
 		void Dialog::UpdateTitle()
 		{
 			setWindowTitle(QStringLiteral("Metrics (%1)").arg(StringConvert::Integer(users.count())));
 		}
+
+		void Dialog::UpdateTraffic()
+		{
+			traffic.setText(QStringList({inbound,outbound}).join('\n'));
+		}
 	}
 
 	namespace VibePlaylist
@@ -25,6 +25,7 @@
 #include <QDialog>
 #include <QDir>
 #include <unordered_set>
+#include <deque>
 #include <concepts>
 #include "entities.h"
 
@@ -61,11 +62,19 @@ class PinnedTextEdit : public QTextEdit
 {
 	Q_OBJECT
 public:
-	PinnedTextEdit(QWidget *parent);
-	void Append(const QString &text,const QString &id);
-	void Remove(const QString &id);
+	PinnedTextEdit(QWidget *parent,std::size_t scrollback=std::numeric_limits<std::size_t>::max());
+	void Append(const QString &text,const QString &id,const QStringList &pending={});
+	void Remove(const QStringList &ids);
+	void Resource(const QString &path,const QImage &image);
+	void Abandon(const QString &path);
 protected:
 	std::unordered_map<QString,QTextFrame*> frames;
+	std::unordered_map<QString,QStringList> waiting; //! image path to the messages that were shown before it arrived
+	std::unordered_map<QString,QStringList> awaiting; //! the other way around, so a message going away can take itself off those lists
+	std::deque<QString> order; //! message IDs, oldest first, so the oldest can be dropped once we pass the scrollback
+	std::size_t scrollback;
+	void Remove(const QString &id);
+	QStringList Release(const QString &path);
 	QPropertyAnimation scrollTransition;
 	void resizeEvent(QResizeEvent *event) override;
 	void contextMenuEvent(QContextMenuEvent *event) override;
@@ -346,6 +355,7 @@ namespace UI
 			bool Duplicates() const;
 			QString Message() const;
 			bool Protected() const;
+			const Cooldown::Policy& Limits() const;
 			void ToggleFold();
 		protected:
 			QGridLayout layout;
@@ -363,6 +373,7 @@ namespace UI
 			EphemeralWidget<QCheckBox> duplicates;
 			EphemeralWidget<QCheckBox> protect;
 			EphemeralWidget<QTextEdit> message;
+			Cooldown::Policy limits; //! only set in commands.json for now, but carried through so saving doesn't lose them
 			Feedback::Error &errorReport;
 			void UpdateName();
 			void UpdateDescription(const QString &text);
@@ -774,14 +785,21 @@ namespace UI
 		public:
 			Dialog(QWidget *parent);
 		protected:
-			QHBoxLayout layout;
+			QVBoxLayout layout;
 			QListWidget users;
+			QLabel traffic;
+			QString outbound;
+			QString inbound;
+			std::unordered_map<QString,QListWidgetItem*> index; //! saves searching the list widget for every join, part, and acknowledgement
 			static const QString TITLE;
 			void UpdateTitle();
+			void UpdateTraffic();
 		public slots:
-			void Joined(const QString &user);
+			void Joined(const QStringList &batch);
 			void Acknowledged(const QString &name);
-			void Parted(const QString &user);
+			void Parted(const QStringList &batch);
+			void Outbound(qsizetype queued,quint64 sent,quint64 dropped);
+			void Inbound(std::size_t waiting,quint64 stalls);
 		};
 	}
 
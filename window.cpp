@@ -30,6 +30,7 @@ Window::Window() : QMainWindow(nullptr),
 	configureEventSubscriptions("Event Subscriptions",this),
 	metrics("Metrics",this),
 	vibePlaylist("Vibe Playlist",this),
+	exportViewers("Export Viewers",this),
 	status("Status",this)
 {
 	setAttribute(Qt::WA_TranslucentBackground,true);
@@ -58,6 +59,7 @@ Window::Window() : QMainWindow(nullptr),
 	connect(&configureEventSubscriptions,&QAction::triggered,this,&Window::ConfigureEventSubscriptions);
 	connect(&metrics,&QAction::triggered,this,&Window::ShowMetrics);
 	connect(&vibePlaylist,&QAction::triggered,this,&Window::ShowVibePlaylist);
+	connect(&exportViewers,&QAction::triggered,this,&Window::ExportViewers);
 	connect(&status,&QAction::triggered,this,&Window::ShowStatus);
 
 	StatusPane *pane=new StatusPane(this);
@@ -210,7 +212,9 @@ void Window::ShowChat()
 	ChatPane *chatPane=new ChatPane(this);
 	SwapPersistentPane(chatPane);
 	connect(this,&Window::ChatMessage,chatPane,&ChatPane::Message);
-	connect(this,&Window::DeleteChatMessage,chatPane,&ChatPane::DeleteMessage);
+	connect(this,&Window::DeleteChatMessages,chatPane,&ChatPane::DeleteMessages);
+	connect(this,&Window::ChatAsset,chatPane,&ChatPane::Asset);
+	connect(this,&Window::ChatAssetFailed,chatPane,&ChatPane::AssetFailed);
 	connect(this,&Window::RefreshChat,chatPane,&ChatPane::Refresh);
 	connect(this,&Window::SetAgenda,chatPane,&ChatPane::SetAgenda);
 	connect(chatPane,&ChatPane::ContextMenu,this,&Window::contextMenuEvent);
@@ -496,6 +500,7 @@ void Window::contextMenuEvent(QContextMenuEvent *event)
 	menu.addSeparator();
 	menu.addAction(&configureEventSubscriptions);
 	menu.addAction(&metrics);
+	menu.addAction(&exportViewers);
 	menu.addSeparator();
 	menu.addAction(&status);
 	menu.exec(event->globalPos());
@@ -25,6 +25,7 @@ protected:
 	QAction configureEventSubscriptions;
 	QAction metrics;
 	QAction vibePlaylist;
+	QAction exportViewers;
 	QAction status;
 	void SwapPersistentPane(PersistentPane *pane);
 	void ReleaseLiveEphemeralPane();
@@ -35,7 +36,9 @@ signals:
 	void Print(const QString &message);
 	void Print(const QString &message,const QString &operation,const QString &subsystem="main window");
 	void ChatMessage(std::shared_ptr<Chat::Message> message);
-	void DeleteChatMessage(const QString &id);
+	void DeleteChatMessages(const QStringList &ids);
+	void ChatAsset(const QString &path,const QImage &image);
+	void ChatAssetFailed(const QString &path);
 	void SetAgenda(const QString &agenda);
 	void RefreshChat();
 	void SuppressMusic();
@@ -45,6 +48,7 @@ signals:
 	void ConfigureEventSubscriptions();
 	void ShowMetrics();
 	void ShowVibePlaylist();
+	void ExportViewers();
 	void ShowStatus();
 	void CloseRequested(QCloseEvent *event);
 public slots: